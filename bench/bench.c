@@ -0,0 +1,636 @@
+// opusplay benchmark suite
+//
+// Generates synthetic Ogg Opus and custom-format inputs, then times the
+// hot paths: container parsing, page CRC verification, opus_decode, float
+// to int16 conversion, resampling, downmixing and audio_callback. Results
+// are printed as CSV (one row per measurement, fixed columns) so runs can
+// be diffed or collected by scripts.
+
+#include "common.h"
+#include "audio_callback.h"
+#include "input_source.h"
+#include "ogg_reader.h"
+#include "ogg_crc.h"
+#include "seek_index.h"
+#include "pcm_convert.h"
+#include "resampler.h"
+#include "downmix.h"
+#include "timer.h"
+#include <math.h>
+
+#define BENCH_MIN_SECONDS 0.3
+#define BENCH_AUDIO_SECONDS 60
+#define BENCH_OGG_FILE "bench_synthetic.opus"
+#define BENCH_CUSTOM_FILE "bench_synthetic.raw"
+#define BENCH_SEEK_FILE "bench_seek.opus"
+
+// Required by the player modules
+volatile sig_atomic_t stop_playback = 0;
+
+// Checks that fail the run, so make bench exits non-zero on a regression
+static int failures = 0;
+
+// Allocation counting for code linked into this binary (-Wl,--wrap)
+static unsigned long long alloc_count = 0;
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__wrap_malloc(size_t size) { alloc_count++; return __real_malloc(size); }
+void *__wrap_realloc(void *ptr, size_t size) { alloc_count++; return __real_realloc(ptr, size); }
+void *__wrap_calloc(size_t count, size_t size) { alloc_count++; return __real_calloc(count, size); }
+
+typedef struct {
+    unsigned char *data;
+    int *sizes;
+    int count;
+    int capacity;
+    int bytes;
+} PacketList;
+
+static void report(const char *name, unsigned long long ops, double seconds, double value, const char *unit) {
+    printf("%s,%llu,%.1f,%.3f,%s\n", name, ops, seconds * 1e9 / (double)ops, value, unit);
+    fflush(stdout);
+}
+
+// Deterministic test signal: two sweeping tones plus a little noise
+static void synth_pcm(short *pcm, int frames, int channels, long long start) {
+    static unsigned int noise = 12345;
+    for (int i = 0; i < frames; i++) {
+        double t = (double)(start + i) / SAMPLE_RATE;
+        for (int c = 0; c < channels; c++) {
+            noise = noise * 1103515245u + 12345u;
+            double v = 0.4 * sin(2 * M_PI * (220.0 + 40.0 * t) * t * (c + 1))
+                     + 0.2 * sin(2 * M_PI * 3000.0 * t)
+                     + 0.02 * ((int)(noise >> 16) - 32768) / 32768.0;
+            pcm[i * channels + c] = (short)(v * 32767);
+        }
+    }
+}
+
+static int encode_packets(PacketList *list, int channels, int frame_size, int seconds) {
+    int err;
+    OpusEncoder *enc = opus_encoder_create(SAMPLE_RATE, channels, OPUS_APPLICATION_AUDIO, &err);
+    if (err != OPUS_OK) {
+        fprintf(stderr, "Error: Failed to create encoder: %s\n", opus_strerror(err));
+        return 0;
+    }
+    opus_encoder_ctl(enc, OPUS_SET_BITRATE(64000 * channels));
+
+    int frames = SAMPLE_RATE * seconds / frame_size;
+    short *pcm = (short*)malloc(frame_size * channels * sizeof(short));
+    list->capacity = frames;
+    list->count = 0;
+    list->bytes = 0;
+    list->data = (unsigned char*)malloc((size_t)frames * MAX_PACKET_SIZE);
+    list->sizes = (int*)malloc(frames * sizeof(int));
+
+    for (int i = 0; i < frames; i++) {
+        synth_pcm(pcm, frame_size, channels, (long long)i * frame_size);
+        int len = opus_encode(enc, pcm, frame_size, list->data + list->bytes, MAX_PACKET_SIZE);
+        if (len < 0) {
+            fprintf(stderr, "Error: Encode failed: %s\n", opus_strerror(len));
+            break;
+        }
+        list->sizes[list->count++] = len;
+        list->bytes += len;
+    }
+
+    free(pcm);
+    opus_encoder_destroy(enc);
+    return list->count > 0;
+}
+
+static void packet_list_free(PacketList *list) {
+    free(list->data);
+    free(list->sizes);
+}
+
+static void write_ogg_page(FILE *f, unsigned int serial, unsigned int sequence,
+                           unsigned long long granule, unsigned char header_type,
+                           const unsigned char *segments, int num_segments,
+                           const unsigned char *payload, int payload_size) {
+    OggPageHeader header;
+    memcpy(header.capture_pattern, "OggS", 4);
+    header.version = 0;
+    header.header_type = header_type;
+    header.granule_position = granule;
+    header.serial_number = serial;
+    header.page_sequence = sequence;
+    header.checksum = 0;
+    header.page_segments = (unsigned char)num_segments;
+
+    // Checksum over the page with the field zeroed (little-endian hosts)
+    unsigned int crc = ogg_crc_update(0, (const unsigned char*)&header, 27);
+    crc = ogg_crc_update(crc, segments, num_segments);
+    header.checksum = ogg_crc_update(crc, payload, payload_size);
+
+    fwrite(&header, 27, 1, f);
+    fwrite(segments, 1, num_segments, f);
+    fwrite(payload, 1, payload_size, f);
+}
+
+// One-packet page (OpusHead/OpusTags)
+static void write_ogg_header_page(FILE *f, unsigned int serial, unsigned int sequence,
+                                  unsigned char header_type, const unsigned char *packet, int size) {
+    unsigned char segments[255];
+    int n = 0;
+    int left = size;
+    while (left >= 255) {
+        segments[n++] = 255;
+        left -= 255;
+    }
+    segments[n++] = (unsigned char)left;
+    write_ogg_page(f, serial, sequence, 0, header_type, segments, n, packet, size);
+}
+
+// Pages are cut at the payload limits in page_bytes, cycled through in turn
+static int write_ogg_file(const char *path, const PacketList *list, int channels, int frame_size,
+                          const int *page_bytes, int num_page_bytes) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+
+    unsigned char head[19] = { 'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, (unsigned char)channels,
+                               0x38, 0x01, 0x80, 0xBB, 0x00, 0x00, 0, 0, 0 };
+    unsigned char tags[16] = { 'O', 'p', 'u', 's', 'T', 'a', 'g', 's', 0, 0, 0, 0, 0, 0, 0, 0 };
+    write_ogg_header_page(f, 1, 0, 0x02, head, sizeof(head));
+    write_ogg_header_page(f, 1, 1, 0x00, tags, sizeof(tags));
+
+    unsigned char segments[255];
+    unsigned int sequence = 2;
+    unsigned long long granule = 0;
+    int offset = 0;
+    int i = 0;
+    while (i < list->count) {
+        int num_segments = 0;
+        int page_start = offset;
+        int page_limit = page_bytes[(sequence - 2) % num_page_bytes];
+        while (i < list->count && num_segments + list->sizes[i] / 255 + 1 <= 255 &&
+               (offset == page_start || offset - page_start + list->sizes[i] < page_limit)) {
+            int left = list->sizes[i];
+            while (left >= 255) {
+                segments[num_segments++] = 255;
+                left -= 255;
+            }
+            segments[num_segments++] = (unsigned char)left;
+            offset += list->sizes[i];
+            granule += frame_size;
+            i++;
+        }
+        write_ogg_page(f, 1, sequence++, granule, (i == list->count) ? 0x04 : 0x00,
+                       segments, num_segments, list->data + page_start, offset - page_start);
+    }
+
+    fclose(f);
+    return 1;
+}
+
+static int write_custom_file(const char *path, const PacketList *list, int channels) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+
+    OpusHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "OpusHead", 8);
+    header.version = 1;
+    header.channel_count = (unsigned char)channels;
+    header.pre_skip = 312;
+    header.sample_rate = SAMPLE_RATE;
+    fwrite(&header, sizeof(header), 1, f);
+
+    int offset = 0;
+    for (int i = 0; i < list->count; i++) {
+        unsigned int size = list->sizes[i];
+        fwrite(&size, sizeof(size), 1, f);
+        fwrite(list->data + offset, 1, size, f);
+        offset += size;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+static void bench_ogg_parse(const char *path, OggCrcMode crc_mode) {
+    unsigned long long pages = 0, packets = 0, bytes = 0;
+    unsigned long long allocs = 0, bad_pages = 0;
+    double elapsed = 0;
+
+    while (elapsed < BENCH_MIN_SECONDS) {
+        InputSource in;
+        OggReader reader;
+        if (!input_open(&in, path)) return;
+        if (!ogg_reader_init(&reader, &in)) {
+            input_close(&in);
+            return;
+        }
+        reader.crc_mode = crc_mode;
+
+        double start = timer_now();
+        unsigned long long allocs_before = alloc_count;
+        while (ogg_reader_read_page(&reader) > 0) {
+            pages++;
+            packets += reader.num_packets;
+        }
+        allocs += alloc_count - allocs_before;
+        elapsed += timer_now() - start;
+        bytes += input_tell(&in);
+        bad_pages += reader.damage.bad_pages;
+
+        ogg_reader_free(&reader);
+        input_close(&in);
+    }
+
+    if (crc_mode != OGG_CRC_OFF) {
+        if (bad_pages > 0) {
+            fprintf(stderr, "Error: %llu benchmark pages failed the CRC\n", bad_pages);
+            failures++;
+        }
+        report("ogg_parse_page_crc", pages, elapsed, bytes / elapsed / 1e6, "MB/s");
+        return;
+    }
+    report("ogg_parse_page", pages, elapsed, bytes / elapsed / 1e6, "MB/s");
+    report("ogg_parse_packet", packets, elapsed, packets / elapsed, "packets/s");
+    report("ogg_parse_allocs", pages, elapsed, (double)allocs / pages, "allocs/page");
+
+    // Once the reader is set up, pages are parsed as views into the input
+    if (allocs > 0) {
+        fprintf(stderr, "Error: Ogg parsing allocated %llu times over %llu pages; expected none\n", allocs, pages);
+        failures++;
+    }
+}
+
+// Raw CRC throughput over a 1 MB buffer, against memcpy of the same size
+static void bench_crc(void) {
+    const size_t size = 1 << 20;
+    unsigned char *data = (unsigned char*)malloc(size);
+    unsigned char *copy = (unsigned char*)malloc(size);
+    if (!data || !copy) {
+        free(data);
+        free(copy);
+        return;
+    }
+    unsigned int seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+
+    if (ogg_crc_update(0, data, size) != ogg_crc_update_bytewise(0, data, size)) {
+        fprintf(stderr, "Error: %s CRC disagrees with the bytewise reference\n", ogg_crc_kernel());
+        failures++;
+    }
+
+    char kernel_name[64];
+    snprintf(kernel_name, sizeof(kernel_name), "ogg_crc_%s", ogg_crc_kernel());
+    const char *names[] = { "memcpy", "ogg_crc_bytewise", kernel_name };
+    volatile unsigned int sink = 0;
+    for (int kind = 0; kind < 3; kind++) {
+        unsigned long long calls = 0;
+        double start = timer_now();
+        double elapsed = 0;
+        while (elapsed < BENCH_MIN_SECONDS) {
+            if (kind == 0) {
+                memcpy(copy, data, size);
+                sink ^= copy[calls & (size - 1)];
+            } else if (kind == 1) {
+                sink ^= ogg_crc_update_bytewise(0, data, size);
+            } else {
+                sink ^= ogg_crc_update(0, data, size);
+            }
+            calls++;
+            elapsed = timer_now() - start;
+        }
+        report(names[kind], calls, elapsed, calls * (double)size / elapsed / 1e6, "MB/s");
+    }
+    (void)sink;
+
+    free(data);
+    free(copy);
+}
+
+static void bench_custom_parse(const char *path) {
+    unsigned long long packets = 0, bytes = 0;
+    double elapsed = 0;
+
+    while (elapsed < BENCH_MIN_SECONDS) {
+        InputSource in;
+        if (!input_open(&in, path)) return;
+
+        double start = timer_now();
+        input_skip(&in, sizeof(OpusHeader));
+        for (;;) {
+            const unsigned char *record;
+            unsigned int size;
+            if (input_peek(&in, sizeof(size), &record) != sizeof(size)) break;
+            memcpy(&size, record, sizeof(size));
+            if (input_peek(&in, sizeof(size) + size, &record) != sizeof(size) + size) break;
+            input_skip(&in, sizeof(size) + size);
+            packets++;
+        }
+        elapsed += timer_now() - start;
+        bytes += input_tell(&in);
+
+        input_close(&in);
+    }
+
+    report("custom_parse_packet", packets, elapsed, bytes / elapsed / 1e6, "MB/s");
+}
+
+// Seeks to every 20 ms of a file cut into pages of page_bytes. Pages of
+// tens of KB straddle the bisection midpoints. Each target gets a fresh
+// index (a cold bisection); a shared one covers the cached path.
+static void bench_seek_index(const char *name, const PacketList *list, int frame_size, int page_bytes) {
+    if (!write_ogg_file(BENCH_SEEK_FILE, list, 2, frame_size, &page_bytes, 1)) return;
+    long long total = (long long)list->count * frame_size;
+
+    InputSource in;
+    OggReader reader;
+    if (!input_open(&in, BENCH_SEEK_FILE)) return;
+    if (!ogg_reader_init(&reader, &in)) {
+        input_close(&in);
+        return;
+    }
+    ogg_reader_read_page(&reader);
+    ogg_reader_read_page(&reader);
+    size_t first_offset = (size_t)input_tell(&in);
+
+    SeekIndex shared;
+    unsigned long long seeks = 0, bad = 0;
+    double start = timer_now();
+    if (seek_index_init(&shared, in.data, in.size, first_offset, 1)) {
+        for (long long target = 0; target < total; target += 960) {
+            SeekIndex cold;
+            SeekPoint point[2];
+            size_t page_size;
+            if (!seek_index_init(&cold, in.data, in.size, first_offset, 1)) break;
+            int found = seek_index_find(&cold, target, &point[0]) && seek_index_find(&shared, target, &point[1]);
+            seek_index_free(&cold);
+            for (int i = 0; i < 2; i++) {
+                if (!found || point[i].granule > target || point[i].offset >= in.size ||
+                    ogg_page_size(in.data + point[i].offset, in.size - point[i].offset, &page_size) != 1) {
+                    bad++;
+                    break;
+                }
+            }
+            seeks += 2;
+        }
+        seek_index_free(&shared);
+    }
+    double elapsed = timer_now() - start;
+
+    ogg_reader_free(&reader);
+    input_close(&in);
+
+    if (seeks == 0 || bad > 0) {
+        fprintf(stderr, "Error: %s: %llu of %llu seek targets got a bad point\n", name, bad, seeks / 2);
+        failures++;
+        return;
+    }
+    report(name, seeks, elapsed, seeks / elapsed, "seeks/s");
+}
+
+static void bench_decode(int channels, int frame_size) {
+    PacketList list;
+    if (!encode_packets(&list, channels, frame_size, 2)) return;
+
+    int err;
+    OpusDecoder *decoder = opus_decoder_create(SAMPLE_RATE, channels, &err);
+    if (err != OPUS_OK) {
+        packet_list_free(&list);
+        return;
+    }
+    short *pcm = (short*)malloc(FRAME_SIZE * channels * sizeof(short));
+
+    unsigned long long packets = 0, samples = 0;
+    double start = timer_now();
+    double elapsed = 0;
+    while (elapsed < BENCH_MIN_SECONDS) {
+        int offset = 0;
+        for (int i = 0; i < list.count; i++) {
+            int n = opus_decode(decoder, list.data + offset, list.sizes[i], pcm, FRAME_SIZE, 0);
+            if (n > 0) samples += n;
+            offset += list.sizes[i];
+            packets++;
+        }
+        elapsed = timer_now() - start;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "opus_decode_%s_%d", channels == 1 ? "mono" : "stereo", frame_size);
+    report(name, packets, elapsed, (double)samples / SAMPLE_RATE / elapsed, "x_realtime");
+
+    free(pcm);
+    opus_decoder_destroy(decoder);
+    packet_list_free(&list);
+}
+
+// One decoded 120 ms stereo frame per op, with gain applied and dither on
+static void bench_convert(const char *name, int simd) {
+    const size_t samples = FRAME_SIZE * 2;
+    float *in = (float*)malloc(samples * sizeof(float));
+    short *out = (short*)malloc(samples * sizeof(short));
+    PcmDither *dither = (PcmDither*)malloc(sizeof(PcmDither));
+    if (!in || !out || !dither) {
+        free(in);
+        free(out);
+        free(dither);
+        return;
+    }
+
+    synth_pcm(out, FRAME_SIZE, 2, 0);
+    for (size_t i = 0; i < samples; i++) in[i] = out[i] / 32768.0f;
+    pcm_dither_init(dither, 1);
+
+    unsigned long long ops = 0;
+    double start = timer_now();
+    double elapsed = 0;
+    while (elapsed < BENCH_MIN_SECONDS) {
+        for (int i = 0; i < 1000; i++) {
+            if (simd) pcm_float_to_s16(in, out, samples, 0.7f, dither);
+            else pcm_float_to_s16_scalar(in, out, samples, 0.7f, dither);
+        }
+        ops += 1000;
+        elapsed = timer_now() - start;
+    }
+
+    report(name, ops, elapsed, ops * samples / elapsed / 1e6, "Msamples/s");
+
+    free(in);
+    free(out);
+    free(dither);
+}
+
+// Stereo 20 ms frames through the resampler; the value is input frames per
+// second, so realtime is the input rate
+static void bench_resample(int in_rate, int out_rate, int simd) {
+    const size_t frames = 960;
+    Resampler *r = resampler_create(in_rate, out_rate, 2);
+    short *in = (short*)malloc(frames * 2 * sizeof(short));
+    short *out = r ? (short*)malloc(resampler_max_output(r, frames) * 2 * sizeof(short)) : NULL;
+    if (!r || !in || !out) {
+        resampler_free(r);
+        free(in);
+        free(out);
+        return;
+    }
+    if (!simd) resampler_use_scalar(r);
+    synth_pcm(in, (int)frames, 2, 0);
+
+    unsigned long long ops = 0;
+    double start = timer_now();
+    double elapsed = 0;
+    while (elapsed < BENCH_MIN_SECONDS) {
+        for (int i = 0; i < 100; i++) {
+            resampler_process(r, in, frames, out);
+        }
+        ops += 100;
+        elapsed = timer_now() - start;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "resample_%d_%d_%s", in_rate, out_rate, simd ? resampler_kernel() : "scalar");
+    report(name, ops, elapsed, ops * frames / elapsed / 1e6, "Mframes/s");
+
+    resampler_free(r);
+    free(in);
+    free(out);
+}
+
+// 20 ms frames of Vorbis-order surround folded down; the value is frames
+// per second
+static void bench_downmix(int in_channels, int out_channels, int simd) {
+    const size_t frames = 960;
+    Downmix *d = downmix_create(1, in_channels, out_channels);
+    short *in = (short*)malloc(frames * in_channels * sizeof(short));
+    short *out = (short*)malloc(frames * out_channels * sizeof(short));
+    if (!d || !in || !out) {
+        downmix_free(d);
+        free(in);
+        free(out);
+        return;
+    }
+    if (!simd) downmix_use_scalar(d);
+    synth_pcm(in, (int)frames, in_channels, 0);
+
+    unsigned long long ops = 0;
+    double start = timer_now();
+    double elapsed = 0;
+    while (elapsed < BENCH_MIN_SECONDS) {
+        for (int i = 0; i < 100; i++) {
+            downmix_process(d, in, out, frames);
+        }
+        ops += 100;
+        elapsed = timer_now() - start;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "downmix_%d_%d_%s", in_channels, out_channels, downmix_kernel(d));
+    report(name, ops, elapsed, ops * frames / elapsed / 1e6, "Mframes/s");
+
+    downmix_free(d);
+    free(in);
+    free(out);
+}
+
+static void bench_callback(int channels) {
+    const unsigned long frames_per_buffer = 256;
+    AudioData data;
+    memset(&data, 0, sizeof(data));
+    if (!ring_buffer_init(&data.ring, (size_t)SAMPLE_RATE * channels)) return;
+    if (!wakeup_init(&data.wakeup)) {
+        ring_buffer_free(&data.ring);
+        return;
+    }
+    data.channels = channels;
+    data.sample_rate = SAMPLE_RATE;
+    atomic_init(&data.producer_waiting, 0);
+    atomic_init(&data.first_audio_us, -1);
+    stats_init(&data.stats);
+
+    short *fill = (short*)calloc(data.ring.capacity, sizeof(short));
+    short *out = (short*)malloc(frames_per_buffer * channels * sizeof(short));
+    synth_pcm(fill, (int)(data.ring.capacity / channels), channels, 0);
+
+    // Refill outside the timed region, then drain through the callback.
+    // An odd fill size keeps the read position moving across the wrap point.
+    size_t chunk = data.ring.capacity - frames_per_buffer * channels / 2;
+    unsigned long long calls = 0;
+    double elapsed = 0;
+    while (elapsed < BENCH_MIN_SECONDS) {
+        ring_buffer_write(&data.ring, fill, chunk - ring_buffer_available(&data.ring));
+        int batches = (int)(ring_buffer_available(&data.ring) / (frames_per_buffer * channels));
+
+        double start = timer_now();
+        for (int i = 0; i < batches; i++) {
+            audio_callback(NULL, out, frames_per_buffer, NULL, 0, &data);
+        }
+        elapsed += timer_now() - start;
+        calls += batches;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "audio_callback_%s_256", channels == 1 ? "mono" : "stereo");
+    report(name, calls, elapsed, calls * frames_per_buffer * channels * sizeof(short) / elapsed / 1e6, "MB/s");
+
+    free(out);
+    free(fill);
+    wakeup_free(&data.wakeup);
+    ring_buffer_free(&data.ring);
+}
+
+int main(void) {
+    static const int frame_sizes[] = { 120, 240, 480, 960, 1920, 2880 };
+
+    // Synthetic inputs: 60 s stereo, 20 ms frames
+    PacketList list;
+    if (!encode_packets(&list, 2, 960, BENCH_AUDIO_SECONDS)) return 1;
+    // Roughly one second of packets per page, as libopusenc does
+    static const int one_second_pages[] = { 48000 };
+    if (!write_ogg_file(BENCH_OGG_FILE, &list, 2, 960, one_second_pages, 1) ||
+        !write_custom_file(BENCH_CUSTOM_FILE, &list, 2)) {
+        fprintf(stderr, "Error: Cannot write benchmark inputs\n");
+        packet_list_free(&list);
+        return 1;
+    }
+    packet_list_free(&list);
+
+    printf("name,iterations,ns_per_op,value,unit\n");
+
+    bench_ogg_parse(BENCH_OGG_FILE, OGG_CRC_OFF);
+    bench_ogg_parse(BENCH_OGG_FILE, OGG_CRC_STRICT);
+    bench_crc();
+    bench_custom_parse(BENCH_CUSTOM_FILE);
+
+    // Seek index over 2 minutes of 60 ms frames, in small and large pages
+    if (encode_packets(&list, 2, 2880, 120)) {
+        bench_seek_index("seek_index_find_8k", &list, 2880, 8000);
+        bench_seek_index("seek_index_find_60k", &list, 2880, 60000);
+        packet_list_free(&list);
+    }
+
+    for (int channels = 1; channels <= 2; channels++) {
+        for (size_t i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++) {
+            bench_decode(channels, frame_sizes[i]);
+        }
+    }
+
+    char convert_name[64];
+    snprintf(convert_name, sizeof(convert_name), "pcm_convert_%s", pcm_convert_kernel());
+    bench_convert("pcm_convert_scalar", 0);
+    bench_convert(convert_name, 1);
+
+    bench_resample(48000, 44100, 0);
+    bench_resample(48000, 44100, 1);
+    bench_resample(48000, 96000, 1);
+
+    bench_downmix(6, 2, 0);
+    bench_downmix(6, 2, 1);
+    bench_downmix(8, 2, 1);
+    bench_downmix(6, 1, 1);
+
+    bench_callback(1);
+    bench_callback(2);
+
+    remove(BENCH_OGG_FILE);
+    remove(BENCH_CUSTOM_FILE);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+#ifndef AUDIO_BACKEND_H
+#define AUDIO_BACKEND_H
+
+// Pa_Initialize() enumerates every host API and device, which takes
+// hundreds of milliseconds on some ALSA/PulseAudio systems. Preloading
+// runs it on a thread while the input is opened and parsed; the device
+// output then only waits for whatever is left of it.
+void audio_backend_preload(void);
+
+// Reference-counted PortAudio initialisation; each successful acquire is
+// paired with a release. Returns 1 on success.
+int audio_backend_acquire(void);
+void audio_backend_release(void);
+
+// Drops the preload's own reference (call once, before exit)
+void audio_backend_shutdown(void);
+
+// Default sample rate of the default output device, 0 if there is none
+int audio_backend_device_rate(void);
+
+// How long the preloaded Pa_Initialize() took, 0 if it was not preloaded
+double audio_backend_init_seconds(void);
+
+#endif // AUDIO_BACKEND_H
@@ -0,0 +1,134 @@
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#include "common.h"
+#include "pcm_convert.h"
+#include "resampler.h"
+#include "downmix.h"
+#include "mixer.h"
+#include "sim_device.h"
+
+typedef enum {
+    OUTPUT_DEVICE,  // PortAudio playback, paced by the device
+    OUTPUT_NULL,    // decode as fast as possible and discard
+    OUTPUT_FILE     // decode as fast as possible into WAV/raw PCM
+} OutputMode;
+
+typedef struct {
+    OutputMode mode;
+    const char *path;  // OUTPUT_FILE: file name, or "-" for stdout
+    int raw;           // OUTPUT_FILE: headerless PCM instead of WAV
+    short *scratch;    // optional caller-owned FRAME_SIZE * 2 decode buffer (up to stereo)
+    unsigned long long length_frames;  // frames that will be written, 0 if unknown
+    double volume_db;  // software volume, added to the stream's output gain
+    int float_pcm;     // decode to float and convert with the SIMD kernel
+    int dither;        // TPDF dither when converting (float path)
+    int buffer_ms;     // OUTPUT_DEVICE: queue depth, 0 for DEFAULT_BUFFER_MS
+    int frames_per_buffer;  // OUTPUT_DEVICE: 0 for the default, -1 to let PortAudio choose
+    double latency_ms;      // OUTPUT_DEVICE: suggested latency, 0 for the device's low latency
+    int device_rate;        // OUTPUT_DEVICE: stream rate, 0 for the device's default
+    int device_channels;    // OUTPUT_DEVICE: channel limit, 0 for the device's maximum
+    int mapping_family;     // Opus channel mapping family, for the downmix layout
+    MixerSource *mixer_source;  // OUTPUT_DEVICE: feed this mixer source (at exactly device_rate
+                                // and device_channels) instead of opening a stream
+    const SimConfig *simulate;  // OUTPUT_DEVICE: drive the callback from a virtual clock
+                                // instead of a device (device_rate, else 48000 Hz)
+    int stats;              // print underrun/timing stats after playback
+    const char *stats_json; // periodic JSON stats lines to this file, "-" for stderr
+    double stats_interval;  // seconds between JSON lines, 0 for 1
+    double launch_time;     // timer_now() at program start, for time to first sample (0: not reported)
+    int realtime;           // OUTPUT_DEVICE: pre-fault and lock the ring and scratch buffers
+} OutputConfig;
+
+// Destination for decoded PCM, shared by both players
+typedef struct {
+    OutputConfig config;
+    int sample_rate;
+    int channels;
+    int device_rate;   // rate of the ring and stream; differs from sample_rate when resampling
+    int device_channels;  // channels of the ring and stream; fewer than channels when downmixing
+
+    // OUTPUT_DEVICE
+    AudioData audio_data;
+    PaStream *stream;
+    size_t max_buffered;
+    size_t prebuffer;          // samples queued before the stream is started
+    int stream_started;
+    double stream_start_time;  // timer_now() at Pa_StartStream
+    int direct;
+    Resampler *resampler;      // sample_rate to device_rate, NULL when they match
+    short *resampled;
+    Downmix *downmix;          // channels to device_channels (or up, for a mixer), NULL when they match
+    short *downmixed;          // a frame's worth for the resampler, or one split by the ring's wrap
+    SimDevice *sim;            // simulate: stands in for the stream
+
+    // OUTPUT_FILE
+    FILE *file;
+    int seekable;
+
+    short *scratch;
+    short *reserved;
+
+    // Float path: decoded into float_scratch, converted into reserved
+    int use_float;
+    float scale;
+    float *float_scratch;
+    PcmDither *dither;
+
+    // Realtime: buffer bytes locked, and faulted in but not locked
+    size_t locked_bytes;
+    size_t prefaulted_bytes;
+
+    // Instrumentation (counters live in audio_data.stats for every mode)
+    FILE *stats_file;
+    double next_stats;
+
+    unsigned long long skip_frames;
+    long long end_position;     // stream position after the last frame to keep, -1 for none
+    long long timeline_offset;  // stream position minus frames_written
+    unsigned long long frames_written;
+    unsigned long long packets;
+    double start_time;
+} AudioOutput;
+
+int audio_output_open(AudioOutput *out, const OutputConfig *config, int sample_rate, int channels);
+void audio_output_close(AudioOutput *out);
+
+// Returns room for FRAME_SIZE frames to decode into (directly inside the
+// ring when possible), waiting for the device to drain if it is too full
+short *audio_output_reserve(AudioOutput *out);
+void audio_output_commit(AudioOutput *out, int frames);
+
+// Float path (use_float): decode into the returned buffer, then commit
+float *audio_output_reserve_float(AudioOutput *out);
+void audio_output_commit_float(AudioOutput *out, int frames);
+
+// Output gain in Q7.8 dB from the stream header, applied on the float path
+void audio_output_set_gain(AudioOutput *out, int gain);
+
+// Appends an already decoded block of any length (parallel decode)
+void audio_output_write(AudioOutput *out, const short *pcm, size_t frames, unsigned long long packets);
+
+// Drop the next frames committed (seek pre-roll), or everything already
+// queued but not yet heard (seek during playback)
+void audio_output_skip(AudioOutput *out, unsigned long long frames);
+void audio_output_flush(AudioOutput *out);
+
+// Stream position (frames) of the next committed frame, and of the frame
+// currently audible
+void audio_output_set_position(AudioOutput *out, long long frames);
+long long audio_output_play_position(AudioOutput *out);
+
+// Drop committed frames at or past this stream position (end trimming);
+// -1 removes the limit
+void audio_output_set_end(AudioOutput *out, long long frames);
+
+double audio_output_buffered(AudioOutput *out);
+
+// Playback should end: Ctrl+C, or the mixer cancelled this source
+int audio_output_stopped(const AudioOutput *out);
+void audio_output_progress(AudioOutput *out);
+void audio_output_finish(AudioOutput *out);
+void audio_output_report(AudioOutput *out, unsigned long long input_bytes);
+
+#endif // AUDIO_OUTPUT_H
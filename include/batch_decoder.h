@@ -0,0 +1,18 @@
+#ifndef BATCH_DECODER_H
+#define BATCH_DECODER_H
+
+#include "audio_output.h"
+#include "ogg_crc.h"
+
+typedef struct {
+    const char *source;      // list file (one path per line) or directory
+    int jobs;                // worker threads, 0 = one per CPU
+    OutputMode mode;         // OUTPUT_NULL or OUTPUT_FILE
+    const char *output_dir;  // OUTPUT_FILE: destination for <name>.wav / <name>.raw
+    int raw;
+    OggCrcMode ogg_crc;      // verify Ogg page checksums; bad pages fail the file
+} BatchOptions;
+
+int batch_decode(const BatchOptions *options);
+
+#endif // BATCH_DECODER_H
@@ -6,27 +6,58 @@
 #include <string.h>
 #include <signal.h>
 #include <opus/opus.h>
+#include <opus/opus_multistream.h>
 #include <portaudio.h>
+#include <stdatomic.h>
+#include "ring_buffer.h"
+#include "wakeup.h"
+#include "playback_stats.h"
 
 // Constants
 #define FRAME_SIZE 5760
 #define MAX_PACKET_SIZE 4000
 #define SAMPLE_RATE 48000
-#define BUFFER_SIZE_SECONDS 30
+#define DEFAULT_BUFFER_MS 2000
+#define DEFAULT_FRAMES_PER_BUFFER 256
+#define LOW_LATENCY_BUFFER_MS 20
+#define LOW_LATENCY_FRAMES_PER_BUFFER 64
+#define SEEK_STEP_SECONDS 10
+
+// Samples decoded and discarded before a seek target so the decoder state
+// has converged (RFC 7845 recommends at least 80 ms)
+#define OPUS_PREROLL_SAMPLES 3840
+
+// Longest gap left by damaged Ogg data that is filled with packet-loss
+// concealment; longer (or implausible) gaps reset the decoder instead
+#define OGG_MAX_CONCEAL_SAMPLES (SAMPLE_RATE * 10)
 
 // Global flag for stop playback
-extern volatile int stop_playback;
+extern volatile sig_atomic_t stop_playback;
 
 // Audio stream data structure
 typedef struct {
-    short *pcm_buffer;
-    int buffer_size;
-    volatile int read_position;
-    volatile int write_position;
+    RingBuffer ring;
     int channels;
+    int sample_rate;
     int bitrate;
-    volatile int decoding_finished;
-    volatile int playback_finished;
+    atomic_int decoding_finished;
+    atomic_int playback_finished;
+
+    // The callback wakes a waiting producer once the ring drains to low_water
+    size_t low_water;
+    atomic_int producer_waiting;
+    Wakeup wakeup;
+
+    // Latency from PaStreamCallbackTimeInfo, written only by the callback.
+    // Times are microseconds; first_audio_us is relative to stream_epoch.
+    PaTime stream_epoch;
+    atomic_llong first_audio_us;   // DAC time of the first buffer with audio, -1 until then
+    atomic_llong latency_us;       // newest queued sample to DAC, last full buffer
+    atomic_llong latency_max_us;
+    atomic_llong latency_sum_us;
+    atomic_llong latency_count;
+
+    PlaybackStats stats;
 } AudioData;
 
 // Opus header structure (custom format)
@@ -0,0 +1,50 @@
+#ifndef CUSTOM_OPUS_H
+#define CUSTOM_OPUS_H
+
+#include "common.h"
+#include "input_source.h"
+
+// Custom raw Opus layout:
+//   version 1: OpusHeader, then { uint32 length, packet } records until EOF
+//   version 2: OpusHeader, CustomOpusExtension, records, then an optional
+//              seek table of CustomSeekEntry at seek_table_offset
+#define CUSTOM_OPUS_VERSION_INDEXED 2
+#define CUSTOM_SEEK_INTERVAL_SECONDS 1
+
+typedef struct {
+    unsigned int extension_size;           // sizeof this struct as written
+    unsigned int packet_count;
+    unsigned long long total_samples;      // per channel, at header sample rate
+    unsigned long long seek_table_offset;  // also the end of the packet records
+    unsigned int seek_entry_count;         // 0 = no table
+    unsigned int max_packet_size;
+} CustomOpusExtension;
+
+typedef struct {
+    unsigned long long offset;  // file offset of a packet's length prefix
+    unsigned long long sample;  // samples per channel decoded before it
+} CustomSeekEntry;
+
+typedef struct {
+    OpusHeader header;
+    int indexed;                      // version 2 extension present
+    unsigned long long data_offset;   // first packet record
+    unsigned long long data_end;      // end of packet records, 0 = until EOF
+    unsigned long long total_samples; // 0 = unknown
+    unsigned int packet_count;
+    unsigned int max_packet_size;
+    const unsigned char *seek_table;  // entries inside a mapped input, or NULL
+    unsigned int seek_entry_count;
+} CustomOpusInfo;
+
+// Reads the header (and extension) leaving the input at the first record
+int custom_opus_read_header(InputSource *in, CustomOpusInfo *info);
+
+// Last seek table entry at or before sample; 0 if there is no table
+int custom_opus_find_entry(const CustomOpusInfo *info, unsigned long long sample, CustomSeekEntry *entry);
+
+// Rewrites the records remaining in the input as a version 2 file with a
+// seek table
+int custom_opus_write_indexed(InputSource *in, const CustomOpusInfo *info, const char *path);
+
+#endif // CUSTOM_OPUS_H
@@ -0,0 +1,28 @@
+#ifndef DOWNMIX_H
+#define DOWNMIX_H
+
+#include <stddef.h>
+
+// Folds interleaved int16 frames of one channel count into fewer channels
+// through a gain matrix. Families 0 and 1 use the Vorbis speaker order, so
+// surround is folded by speaker position (centre and surrounds at -3 dB,
+// LFE dropped); other families spread their channels round-robin. Rows are
+// normalised so a full-scale input cannot clip. The same routing spreads
+// mono or stereo over more channels (mixer sources); mono goes to both
+// fronts at -3 dB.
+typedef struct Downmix Downmix;
+
+// NULL if out_channels equals in_channels
+Downmix *downmix_create(int mapping_family, int in_channels, int out_channels);
+void downmix_free(Downmix *d);
+
+// Converts frames; out holds frames * out_channels samples and may be the
+// device ring itself
+void downmix_process(const Downmix *d, const short *in, short *out, size_t frames);
+
+// Name of the kernel in use (AVX2, SSE2 or NEON when available);
+// downmix_use_scalar() switches d to plain C for comparison
+const char *downmix_kernel(const Downmix *d);
+void downmix_use_scalar(Downmix *d);
+
+#endif // DOWNMIX_H
@@ -1,6 +1,8 @@
 #ifndef FORMAT_DETECTOR_H
 #define FORMAT_DETECTOR_H
 
-int detect_format(const char *filename, int *is_ogg);
+#include "input_source.h"
+
+int detect_format(InputSource *in, int *is_ogg);
 
 #endif // FORMAT_DETECTOR_H
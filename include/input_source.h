@@ -0,0 +1,65 @@
+#ifndef INPUT_SOURCE_H
+#define INPUT_SOURCE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define INPUT_BUFFER_SIZE 65536
+#define INPUT_READAHEAD_DEFAULT (1024 * 1024)
+
+// Background reader state (input_source.c)
+typedef struct InputReadAhead InputReadAhead;
+
+typedef struct {
+    size_t depth;                // bytes kept ready ahead of the read position
+    unsigned long long stalls;   // times the consumer had to wait for the reader
+    double stall_seconds;
+} InputReadAheadStats;
+
+// Byte-span view over an input file. Regular files are memory-mapped once
+// and walked in place; anything that cannot be mapped falls back to a
+// buffered window refilled with fread.
+typedef struct {
+    const unsigned char *data;  // current window
+    size_t size;                // valid bytes in window
+    size_t pos;                 // read position within window
+    unsigned long long offset;  // file offset of data[0]
+    int mapped;
+    int eof;
+    FILE *file;
+    unsigned char *buffer;
+    size_t buffer_capacity;
+    InputReadAhead *readahead;
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+} InputSource;
+
+// "-" opens standard input: a redirected regular file is mapped like any
+// other, a pipe or socket is read through the buffered window
+int input_open(InputSource *in, const char *filename);
+int input_is_stdin(const char *filename);
+void input_open_memory(InputSource *in, const unsigned char *data, size_t size);
+void input_close(InputSource *in);
+
+// Make up to n bytes at the read position visible through *ptr without
+// consuming them. Returns how many are available (less than n only at end
+// of input). The pointer stays valid until the next peek or read.
+size_t input_peek(InputSource *in, size_t n, const unsigned char **ptr);
+void input_skip(InputSource *in, size_t n);
+size_t input_read(InputSource *in, void *dst, size_t n);
+unsigned long long input_tell(InputSource *in);
+
+// Random access within mapped/memory inputs; buffered inputs can only move
+// forward. Returns 1 on success.
+int input_seek(InputSource *in, unsigned long long offset);
+
+// Moves file I/O to a background thread that keeps depth bytes ahead of the
+// read position: buffered inputs read into a bounded queue, mapped inputs
+// have their pages faulted in ahead of use. Returns 1 if the reader is
+// running.
+int input_start_readahead(InputSource *in, size_t depth);
+int input_readahead_stats(const InputSource *in, InputReadAheadStats *stats);
+
+#endif // INPUT_SOURCE_H
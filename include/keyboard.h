@@ -0,0 +1,12 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#define KEY_SEEK_BACK    1
+#define KEY_SEEK_FORWARD 2
+
+// Non-blocking single-key input from an interactive terminal
+int keyboard_enable(void);
+void keyboard_restore(void);
+int keyboard_poll(void);
+
+#endif // KEYBOARD_H
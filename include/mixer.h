@@ -0,0 +1,52 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "common.h"
+
+#define MIXER_MAX_SOURCES 32
+
+// One PortAudio stream shared by many sources. Each source is an ordinary
+// device output whose ring the mixer's callback drains with
+// audio_callback(), so underrun handling, wakeups and stats work as for a
+// stream of its own; the sources are then summed with their gains and
+// clipped once.
+typedef struct Mixer Mixer;
+typedef struct MixerSource MixerSource;
+
+// Opens and starts the stream (silence until a source plays). NULL on
+// failure. frames_per_buffer and latency_ms as in OutputConfig.
+Mixer *mixer_create(int sample_rate, int channels, int frames_per_buffer, double latency_ms);
+void mixer_destroy(Mixer *mixer);
+
+int mixer_sample_rate(const Mixer *mixer);
+int mixer_channels(const Mixer *mixer);
+
+// Claims a slot; NULL when all MIXER_MAX_SOURCES are taken. The slot
+// stays silent until an output is bound and started.
+MixerSource *mixer_add(Mixer *mixer, double gain_db);
+
+// Frees the slot once the callback can no longer be reading it
+void mixer_remove(Mixer *mixer, MixerSource *source);
+
+// Producer side (audio_output): attaches the output's ring, which must be
+// at the mixer's rate and channel count; start begins pulling from it.
+// Unbinding waits out any callback still reading the ring.
+void mixer_source_bind(MixerSource *source, AudioData *audio_data);
+void mixer_source_unbind(MixerSource *source);
+void mixer_source_start(MixerSource *source);
+double mixer_source_time(const MixerSource *source);  // stream clock, as Pa_GetStreamTime
+
+// Control side
+void mixer_source_set_gain(MixerSource *source, double gain_db);
+double mixer_source_gain(const MixerSource *source);
+double mixer_source_seconds(const MixerSource *source);  // audio mixed in so far
+
+// Asks the source's player to stop; its output reports it as stopped and
+// the mixer drops it at once
+void mixer_source_cancel(MixerSource *source);
+int mixer_source_cancelled(const MixerSource *source);
+
+// Name of the accumulate kernel in use (AVX2, SSE2 or NEON when available)
+const char *mixer_kernel(void);
+
+#endif // MIXER_H
@@ -0,0 +1,27 @@
+#ifndef MIXER_SERVER_H
+#define MIXER_SERVER_H
+
+#include "player.h"
+
+// Runs one mixed output stream and plays files into it on request, until
+// Ctrl+C or "quit". Commands arrive one per line on a Unix socket:
+//
+//   play [-g <dB>] <path>   start a source      -> ok <id>
+//   stop <id>               end it early        -> ok
+//   gain <id> <dB>          change its gain     -> ok
+//   list                    one line per source -> ok <count>
+//   quit                    stop the server     -> ok
+//
+// Failures reply "error <reason>". Each source decodes on its own thread
+// with options (quiet) into a ring the mixer drains. The stream runs at
+// device_rate (else the device's own rate) with device_channels (else 2).
+int mixer_serve(const PlayerOptions *options, const char *socket_path);
+
+// Client side: sends one command, printing the reply lines. A relative
+// path in "play" is made absolute first, since the server resolves it.
+int mixer_send(const char *socket_path, const char *command);
+
+// $XDG_RUNTIME_DIR/opusplay.sock, else /tmp/opusplay.sock
+const char *mixer_default_socket(void);
+
+#endif // MIXER_SERVER_H
@@ -0,0 +1,30 @@
+#ifndef OGG_CRC_H
+#define OGG_CRC_H
+
+#include <stddef.h>
+
+// What the Ogg reader does with a page whose checksum does not match
+typedef enum {
+    OGG_CRC_OFF,     // not verified (default)
+    OGG_CRC_CHECK,   // count the page and skip it
+    OGG_CRC_STRICT   // fail the read
+} OggCrcMode;
+
+// Ogg CRC-32 (polynomial 0x04C11DB7, MSB first, initial value 0, no final
+// XOR). Long inputs fold 64 bytes at a time with PCLMULQDQ when the CPU
+// has it; everything else uses slicing-by-8 (eight lookups per 8 bytes).
+unsigned int ogg_crc_update(unsigned int crc, const unsigned char *data, size_t size);
+
+// Name of the kernel ogg_crc_update() uses for long inputs
+const char *ogg_crc_kernel(void);
+
+// One table lookup per byte; the reference the benchmark compares against
+unsigned int ogg_crc_update_bytewise(unsigned int crc, const unsigned char *data, size_t size);
+
+// Checksum of a whole page, computed with its checksum field as zero
+unsigned int ogg_page_crc(const unsigned char *page, size_t size);
+
+// 1 if the page's stored checksum matches its contents
+int ogg_page_crc_ok(const unsigned char *page, size_t size);
+
+#endif // OGG_CRC_H
@@ -2,9 +2,82 @@
 #define OGG_READER_H
 
 #include "common.h"
+#include "input_source.h"
+#include "ogg_crc.h"
 
-int read_ogg_page(FILE *fin, OggPageHeader *header, unsigned char **packets, 
-                  int *packet_sizes, int *num_packets);
-int parse_opus_head_ogg(unsigned char *packet, int size, int *sample_rate, int *channels);
+#define OGG_MAX_SEGMENTS 255
+
+// View of one complete packet. Points into the input window or, for
+// packets that spanned pages, into the reassembly buffer; valid until the
+// next ogg_reader_read_page() call.
+typedef struct {
+    const unsigned char *data;
+    int size;
+} OggPacket;
+
+#define OPUS_HEAD_MAX_CHANNELS 255
+
+// Fields of the OpusHead identification header
+typedef struct {
+    int channels;
+    int pre_skip;        // samples at 48 kHz to drop from the decoder output
+    int sample_rate;     // original input rate (informational)
+    int gain;            // output gain, Q7.8 dB
+    int mapping_family;  // 0 mono/stereo, 1 Vorbis surround order, 2 ambisonics, 255 unordered
+    int streams;         // Opus streams in each packet
+    int coupled_streams; // how many of them are stereo
+    unsigned char mapping[OPUS_HEAD_MAX_CHANNELS];  // output channel -> decoded channel, 255 silent
+} OpusHeadInfo;
+
+// Damaged input the reader stepped over
+typedef struct {
+    unsigned long long bad_pages;      // pages whose checksum did not match
+    unsigned long long resyncs;        // searches for the next good page
+    unsigned long long skipped_bytes;  // bytes dropped by those searches
+} OggDamage;
+
+// Page reader walking an InputSource in place. Once a stream's headers
+// are read it follows that logical stream only: pages of other serials
+// (multiplexed streams) are skipped, and a BOS page after the stream's data
+// ends it (chained files whose links lack an EOS flag).
+typedef struct {
+    InputSource *in;
+    unsigned int serial;                 // logical stream being read
+    int locked;                          // serial is set
+    int in_data;                         // past the BOS page of serial
+    OggCrcMode crc_mode;                 // checksum verification of pages read
+    OggDamage damage;
+    int discontinuity;                   // data was skipped before the current page
+    OggPageHeader header;
+    unsigned long long page_offset;      // input position of the current page
+    const unsigned char *segments;
+    const unsigned char *payload;
+    OggPacket packets[OGG_MAX_SEGMENTS];
+    int num_packets;
+    PacketBuffer partial;                // packet continued from earlier pages
+    int has_partial;
+    const unsigned char *tail;           // unfinished packet at end of current page
+    int tail_size;
+} OggReader;
+
+int ogg_reader_init(OggReader *reader, InputSource *in);
+void ogg_reader_free(OggReader *reader);
+int ogg_reader_read_page(OggReader *reader);
+void ogg_reader_reset(OggReader *reader);
+int ogg_reader_read_headers(OggReader *reader, OpusHeadInfo *info);
+
+// Finds the next BOS page carrying OpusHead (the next link of a chained
+// file, or the Opus stream among multiplexed ones), locks onto its serial
+// and skips its tags. Returns 1, 0 at end of input, -1 on a damaged header.
+int ogg_reader_next_stream(OggReader *reader, OpusHeadInfo *info);
+// Stream sample of the first packet on the current page: its granule less
+// the samples of the packets it completes (a packet continued from a
+// skipped page counts as missing), or -1 if the page carries no granule
+long long ogg_reader_page_start(const OggReader *reader);
+int ogg_page_size(const unsigned char *data, size_t available, size_t *page_size);
+int parse_opus_head_ogg(const unsigned char *packet, int size, OpusHeadInfo *info);
+
+// Mapping family 0: one stream, coupled when stereo
+void opus_head_default_mapping(OpusHeadInfo *info, int channels);
 
 #endif // OGG_READER_H
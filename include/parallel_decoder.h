@@ -0,0 +1,14 @@
+#ifndef PARALLEL_DECODER_H
+#define PARALLEL_DECODER_H
+
+#include "input_source.h"
+#include "player.h"
+
+#define PARALLEL_CHUNK_SECONDS 30
+
+// Decodes one Ogg Opus file on several threads by splitting it at page
+// boundaries. Requires a memory-mapped input and a headless output;
+// otherwise falls back to play_ogg_opus().
+int decode_ogg_parallel(InputSource *in, const PlayerOptions *options, int jobs, PlayResult *result);
+
+#endif // PARALLEL_DECODER_H
@@ -0,0 +1,26 @@
+#ifndef PCM_CONVERT_H
+#define PCM_CONVERT_H
+
+#include <stddef.h>
+
+#define PCM_DITHER_TABLE_SIZE 4096  // power of two
+
+// Pre-generated TPDF noise (+/-1 LSB) cycled through by the converter so
+// the SIMD kernels can add it with plain loads
+typedef struct {
+    float noise[PCM_DITHER_TABLE_SIZE];
+    size_t pos;
+} PcmDither;
+
+void pcm_dither_init(PcmDither *dither, unsigned int seed);
+
+// Converts n interleaved float samples to int16 in one pass: multiply by
+// scale (output gain times volume), add dither if given, round to nearest
+// and clip. Uses AVX2, SSE2 or NEON when available.
+void pcm_float_to_s16(const float *in, short *out, size_t n, float scale, PcmDither *dither);
+void pcm_float_to_s16_scalar(const float *in, short *out, size_t n, float scale, PcmDither *dither);
+
+// Name of the kernel pcm_float_to_s16() dispatches to
+const char *pcm_convert_kernel(void);
+
+#endif // PCM_CONVERT_H
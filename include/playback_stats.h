@@ -0,0 +1,48 @@
+#ifndef PLAYBACK_STATS_H
+#define PLAYBACK_STATS_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define STATS_HISTOGRAM_BUCKETS 16
+
+// Log2 histogram of durations: bucket i counts [2^i, 2^(i+1)) microseconds,
+// bucket 0 also takes anything shorter and the last bucket anything longer.
+// One writer thread; readers may see a slightly stale but valid snapshot.
+typedef struct {
+    atomic_uint buckets[STATS_HISTOGRAM_BUCKETS];
+    atomic_ullong count;
+    atomic_ullong total_us;
+    atomic_uint max_us;
+} StatsHistogram;
+
+// Runtime counters. The callback half is updated from the audio thread with
+// relaxed atomics only: no locks, no allocation, no syscalls.
+typedef struct {
+    // Audio callback
+    atomic_ullong callbacks;
+    atomic_ullong underflows;       // host reported paOutputUnderflow
+    atomic_ullong overflows;        // host reported paOutputOverflow
+    atomic_ullong silence_fills;    // buffers padded because the ring ran dry
+    atomic_ullong silence_frames;
+    atomic_llong fill_low_frames;   // lowest ring fill seen by the callback after first audio, -1 before
+    StatsHistogram callback_time;
+
+    // Decode thread
+    atomic_ullong dropped_samples;  // ring had no room on commit
+    StatsHistogram decode_time;
+} PlaybackStats;
+
+void stats_init(PlaybackStats *stats);
+
+// Single-writer increments
+void stats_add(atomic_ullong *counter, unsigned long long n);
+void stats_histogram_add(StatsHistogram *histogram, double seconds);
+
+// Upper bound in microseconds of the bucket holding percentile p (0..1),
+// capped at the maximum seen
+unsigned int stats_histogram_percentile(StatsHistogram *histogram, double p);
+
+void stats_histogram_json(FILE *f, StatsHistogram *histogram);
+
+#endif // PLAYBACK_STATS_H
@@ -1,7 +1,83 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
-int play_custom_opus(const char *filename);
-int play_ogg_opus(const char *filename);
+#include "input_source.h"
+#include "audio_output.h"
+#include "ogg_reader.h"
+
+// Options shared by both players
+typedef struct {
+    OutputConfig output;
+    int quiet;               // no banners or summaries (batch workers)
+    OpusMSDecoder *decoder;  // optional caller-owned decoder, sized for one stereo stream
+    double start_seconds;    // begin playback here (sample-accurate)
+    const char *seek_index_path;  // optional sidecar to load/save the Ogg seek index
+    AudioOutput *shared_output;   // optional caller-owned output kept open across playlist tracks
+    const char *title;            // optional line printed above the banner
+    OggCrcMode ogg_crc;           // Ogg page checksum verification
+} PlayerOptions;
+
+// What a player did with one input
+typedef struct {
+    int sample_rate;
+    int channels;
+    unsigned long long frames;
+    unsigned long long packets;
+    int decode_errors;
+    OggDamage damage;        // Ogg data skipped as damaged
+} PlayResult;
+
+int play_custom_opus(InputSource *in, const PlayerOptions *options, PlayResult *result);
+int play_ogg_opus(InputSource *in, const PlayerOptions *options, PlayResult *result);
+
+// Shared player plumbing
+
+// Rate to decode a stream of stream_rate at. On a device, that is the
+// device's own rate when libopus can decode at it, so nothing downstream
+// resamples; otherwise stream_rate (48 kHz if libopus cannot decode at that
+// either), which the device output resamples.
+int player_decode_rate(const PlayerOptions *options, int stream_rate);
+
+// Multistream decoder for head's channel mapping; family 0 is a single
+// stream, so mono and stereo decode exactly as with a plain decoder
+OpusMSDecoder *player_decoder_create(const PlayerOptions *options, int sample_rate, const OpusHeadInfo *head,
+                                     int *error);
+void player_decoder_destroy(const PlayerOptions *options, OpusMSDecoder *decoder);
+
+// Re-initialises decoder for a new stream (chained Ogg link), in place when
+// its allocation fits the new stream layout, otherwise by replacing it
+OpusMSDecoder *player_decoder_reconfigure(const PlayerOptions *options, OpusMSDecoder *decoder, int sample_rate,
+                                          const OpusHeadInfo *old_head, const OpusHeadInfo *head, int *error);
+void player_finish(const PlayerOptions *options, AudioOutput *out, InputSource *in,
+                   int decode_errors, PlayResult *result);
+
+// Prints what damaged Ogg data was skipped and records it in result
+void player_report_damage(const PlayerOptions *options, const OggDamage *damage, PlayResult *result);
+
+// Opens local, or reuses the shared output when the format matches (the
+// stream keeps running, so tracks join without a gap). A shared output in
+// another format is drained and reopened. Returns NULL on failure.
+AudioOutput *player_open_output(const PlayerOptions *options, AudioOutput *local,
+                                const OutputConfig *config, int sample_rate, int channels);
+void player_close_output(const PlayerOptions *options, AudioOutput *out);
+
+// Switches an open output to a new format mid-file: a no-op when it
+// matches, otherwise a drain and reopen. Returns 0 if the output cannot
+// take the new format; out->channels is 0 if it was closed on the way.
+// A downmixing output also reopens for a new mapping family.
+int player_reformat_output(AudioOutput *out, int sample_rate, int channels, int mapping_family);
+
+// Applies the header's output gain (Q7.8 dB) and drops the pre-skip
+// samples, leaving the output positioned at stream sample pre_skip with no
+// end limit
+void player_start_stream(OpusMSDecoder *decoder, AudioOutput *out, int gain, int pre_skip);
+
+// Decodes one packet into the output (int16 or float path) and commits it;
+// returns the decoder's sample count or error
+int player_decode(OpusMSDecoder *decoder, AudioOutput *out, const unsigned char *data, int size);
+
+// Fills frames of missing audio with the decoder's packet-loss
+// concealment (whole 2.5 ms units; any remainder is left out)
+void player_conceal(OpusMSDecoder *decoder, AudioOutput *out, long long frames);
 
 #endif // PLAYER_H
@@ -0,0 +1,25 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include "player.h"
+
+typedef struct {
+    char **paths;
+    int count;
+    int capacity;
+} Playlist;
+
+int playlist_add(Playlist *playlist, const char *path);
+
+// One path per line; blank lines and '#' lines are skipped, so plain
+// .m3u files load as well
+int playlist_load(Playlist *playlist, const char *list_path);
+void playlist_free(Playlist *playlist);
+
+// Plays the tracks back to back through one output that stays open, with
+// one decoder re-initialised per track. Each track is opened (and its
+// read-ahead started) while the previous one is still playing.
+int playlist_play(const Playlist *playlist, const PlayerOptions *options,
+                  size_t readahead, int use_seek_index);
+
+#endif // PLAYLIST_H
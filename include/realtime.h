@@ -0,0 +1,51 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+
+// Opt-in hardening of the decode thread against host load. Every step
+// falls back when the privilege is missing; RealtimeStatus records what
+// was actually obtained.
+typedef struct {
+    int enabled;
+    char priority[32];     // scheduling obtained ("SCHED_FIFO 10", "nice -10"), empty if none
+    int fifo_error;        // errno when SCHED_FIFO (time-critical on Windows) was refused
+    int cpu;               // CPU the thread is pinned to, -1 if not pinned
+    int pin_error;         // errno of failed pinning (ENOSYS: unsupported here)
+    int memory_locked;     // code, libraries, heap and stack locked (mlockall)
+    int lock_error;        // errno of the failed mlockall
+} RealtimeStatus;
+
+// Raises the calling thread's priority (SCHED_FIFO, else a negative nice
+// value), pins it to cpu (-1: no pinning), pre-faults its stack and locks
+// the pages mapped so far. Buffers allocated later go through
+// realtime_lock(). Only the calling thread is raised: threads it spawns
+// between realtime_suspend() and realtime_resume() do not inherit it.
+const RealtimeStatus *realtime_enter(int cpu);
+
+// Applies the same priority and pinning to another decode thread (mixer
+// sources); a no-op unless realtime_enter() ran
+void realtime_thread(void);
+
+// Called by the audio callback: on its first call on a thread, lifts that
+// thread above the decode threads (SCHED_FIFO one higher, else the same
+// nice value) unless it already runs higher. A no-op unless
+// realtime_enter() ran, and on decode threads (the simulated device).
+void realtime_callback(void);
+
+// Around anything that creates threads (read-ahead, workers, PortAudio's
+// callback thread): returns a raised thread to normal priority on every
+// CPU, then raises it again. Calls nest; no-ops on other threads.
+void realtime_suspend(void);
+void realtime_resume(void);
+
+int realtime_enabled(void);
+
+// One line saying which guarantees were obtained and why others were not
+void realtime_report(void);
+
+// Pre-faults a freshly allocated buffer (writing zeros) and locks it in
+// memory. Returns 1 if locked; the pages are faulted in either way.
+int realtime_lock(void *data, size_t bytes);
+
+#endif // REALTIME_H
@@ -0,0 +1,38 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stddef.h>
+
+// Polyphase windowed-sinc sample rate converter for interleaved int16.
+// The ratio is reduced to up/down; each of the up phases has its own
+// row of taps, so every output sample is one dot product per channel.
+// The output is aligned with the input: no leading delay, and
+// resampler_drain() returns the tail still held back as look-ahead.
+typedef struct Resampler Resampler;
+
+// NULL if the rates are invalid or their ratio needs too many phases
+Resampler *resampler_create(int in_rate, int out_rate, int channels);
+void resampler_free(Resampler *r);
+
+// Output frames produced by at most in_frames more input frames
+size_t resampler_max_output(const Resampler *r, size_t in_frames);
+
+// Converts in_frames; returns the frames written to out, which must hold
+// resampler_max_output(r, in_frames) frames
+size_t resampler_process(Resampler *r, const short *in, size_t in_frames, short *out);
+
+// Flushes the look-ahead at the end of the input; out holds
+// resampler_max_output(r, 0) frames
+size_t resampler_drain(Resampler *r, short *out);
+
+// Forgets the input so far (seek)
+void resampler_reset(Resampler *r);
+
+int resampler_taps(const Resampler *r);
+
+// Name of the dot product kernel in use (AVX2, SSE2 or NEON when
+// available); resampler_use_scalar() switches r to plain C for comparison
+const char *resampler_kernel(void);
+void resampler_use_scalar(Resampler *r);
+
+#endif // RESAMPLER_H
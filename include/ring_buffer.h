@@ -0,0 +1,44 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Single-producer/single-consumer PCM ring buffer.
+// Capacity is a power of two so positions are mapped with a mask; the
+// positions themselves are free-running unsigned counters, so their
+// difference stays correct across wrap-around.
+typedef struct {
+    short *data;
+    size_t capacity;
+    size_t mask;
+    atomic_size_t read_pos;
+    atomic_size_t write_pos;
+    atomic_size_t discard_to;
+    atomic_int discard_pending;
+} RingBuffer;
+
+int ring_buffer_init(RingBuffer *rb, size_t min_capacity);
+void ring_buffer_free(RingBuffer *rb);
+void ring_buffer_reset(RingBuffer *rb);
+
+// Number of samples ready to read (consumer side) / free to write (producer side)
+size_t ring_buffer_available(RingBuffer *rb);
+size_t ring_buffer_space(RingBuffer *rb);
+
+// Bulk copies, at most two memcpy spans each. Return the number of samples moved.
+size_t ring_buffer_write(RingBuffer *rb, const short *src, size_t count);
+size_t ring_buffer_read(RingBuffer *rb, short *dst, size_t count);
+
+// Zero-copy access: get the contiguous span at the write (read) position,
+// fill (consume) part of it, then commit (release) what was used.
+size_t ring_buffer_write_reserve(RingBuffer *rb, short **span);
+void ring_buffer_write_commit(RingBuffer *rb, size_t count);
+size_t ring_buffer_read_acquire(RingBuffer *rb, const short **span);
+void ring_buffer_read_release(RingBuffer *rb, size_t count);
+
+// Producer side: ask the consumer to drop everything written so far
+// (e.g. on seek). Takes effect at the consumer's next read.
+void ring_buffer_discard(RingBuffer *rb);
+
+#endif // RING_BUFFER_H
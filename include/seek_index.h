@@ -0,0 +1,42 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <stddef.h>
+
+#define SEEK_INDEX_SUFFIX ".seekidx"
+
+// Page at which decoding can start, and the granule position of the first
+// sample its first packet produces
+typedef struct {
+    long long granule;
+    unsigned long long offset;
+} SeekPoint;
+
+// Granule -> byte offset map over a memory-mapped Ogg Opus stream. Starts
+// with only the first audio page; every lookup bisects the file between
+// the nearest known points and remembers what it found, so repeated seeks
+// get cheaper. Only pages of one logical stream (serial) count, so
+// multiplexed and chained files index the stream being played. Can be
+// persisted to a sidecar file.
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    unsigned int serial;
+    SeekPoint *points;
+    int count;
+    int capacity;
+    int dirty;
+    unsigned int fingerprint;
+} SeekIndex;
+
+int seek_index_init(SeekIndex *index, const unsigned char *data, size_t size, size_t first_offset,
+                    unsigned int serial);
+void seek_index_free(SeekIndex *index);
+
+// Latest seek point whose first sample is at or before granule
+int seek_index_find(SeekIndex *index, long long granule, SeekPoint *point);
+
+int seek_index_load(SeekIndex *index, const char *path);
+int seek_index_save(SeekIndex *index, const char *path);
+
+#endif // SEEK_INDEX_H
@@ -1,6 +1,11 @@
 #ifndef SIGNAL_HANDLER_H
 #define SIGNAL_HANDLER_H
 
+// Sets stop_playback; only async-signal-safe calls
 void signal_handler(int sig);
 
+// Installs signal_handler for Ctrl+C (SIGINT) and SIGTERM. Reads and
+// writes resume after it; timed waits and poll() still return early.
+void signal_handler_install(void);
+
 #endif // SIGNAL_HANDLER_H
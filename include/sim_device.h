@@ -0,0 +1,52 @@
+#ifndef SIM_DEVICE_H
+#define SIM_DEVICE_H
+
+#include "common.h"
+
+#define SIM_PATH_MAX 4096
+#define SIM_DEFAULT_RATE 48000  // device rate when none is given
+
+// A stand-in for the PortAudio stream that calls audio_callback() from a
+// virtual clock. Nothing waits on real time: the producer is charged a
+// modelled decode cost per packet, and every callback falling due in that
+// time runs before the packet is published. Runs are deterministic for a
+// given seed and much faster than realtime, with no audio device needed.
+typedef struct {
+    double decode_ms;         // virtual cost of decoding one packet
+    double decode_jitter_ms;  // plus up to this much, uniformly random
+    double stall_ms;          // an I/O stall of this length ...
+    double stall_every;       // ... after every this many seconds of audio decoded (0: none)
+    double jitter_ms;         // callbacks fire up to this much after their nominal time
+    unsigned int seed;
+    char trace_path[SIM_PATH_MAX];  // CSV row per callback (time, queue fill, silence,
+                                    // lateness); empty for none
+} SimConfig;
+
+// Parses "key=value,..." with keys decode, decode-jitter, stall (<ms>/<s>),
+// jitter, seed and trace; unset keys keep their defaults. Returns 0 with
+// an error printed on a bad spec.
+int sim_config_parse(SimConfig *config, const char *spec);
+
+typedef struct SimDevice SimDevice;
+
+// Drains audio_data's ring in buffers of frames_per_buffer, each due
+// latency seconds before it would reach the DAC. NULL on failure.
+SimDevice *sim_device_create(const SimConfig *config, AudioData *audio_data, int sample_rate, int channels,
+                             unsigned long frames_per_buffer, double latency);
+void sim_device_free(SimDevice *sim);
+
+// Virtual stream clock, as Pa_GetStreamTime
+double sim_device_time(const SimDevice *sim);
+void sim_device_start(SimDevice *sim);
+
+// Charges the decode cost of this many packets (and any stall due once
+// seconds more audio is decoded), running the callbacks due meanwhile
+void sim_device_decoded(SimDevice *sim, unsigned long long packets, double seconds);
+
+// As wakeup_wait() on audio_data's wakeup, in virtual time: runs callbacks
+// until one signals or timeout_ms passes. Returns 1 if signalled.
+int sim_device_wait(SimDevice *sim, int timeout_ms);
+
+void sim_device_report(const SimDevice *sim);
+
+#endif // SIM_DEVICE_H
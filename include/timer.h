@@ -0,0 +1,7 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// Monotonic wall clock in seconds
+double timer_now(void);
+
+#endif // TIMER_H
@@ -0,0 +1,24 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+// One-way wakeup from the audio callback to the decode thread. Signalling
+// never blocks or takes a lock (eventfd on Linux, a non-blocking pipe on
+// other POSIX systems, an auto-reset event on Windows), so it is safe to
+// call from the real-time thread.
+typedef struct {
+#ifdef _WIN32
+    void *event;
+#else
+    int read_fd;
+    int write_fd;
+#endif
+} Wakeup;
+
+int wakeup_init(Wakeup *wakeup);
+void wakeup_free(Wakeup *wakeup);
+void wakeup_signal(Wakeup *wakeup);
+
+// Returns 1 if signalled, 0 on timeout
+int wakeup_wait(Wakeup *wakeup, int timeout_ms);
+
+#endif // WAKEUP_H
@@ -0,0 +1,98 @@
+#include "audio_backend.h"
+#include "common.h"
+#include "timer.h"
+#include "realtime.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+
+static pthread_t preload_thread;
+static int preload_pending;    // thread started, not yet joined
+static int preload_held;       // the preload's Pa_Initialize() succeeded
+static PaError preload_error;
+static double preload_seconds;
+
+static void *preload_main(void *arg) {
+    (void)arg;
+    double start = timer_now();
+    preload_error = Pa_Initialize();
+    preload_seconds = timer_now() - start;
+    return NULL;
+}
+
+// Waits for the preload; afterwards PortAudio is initialised (or failed)
+static void preload_join(void) {
+    if (!preload_pending) return;
+    pthread_join(preload_thread, NULL);
+    preload_pending = 0;
+    preload_held = (preload_error == paNoError);
+}
+
+void audio_backend_preload(void) {
+    if (preload_pending || preload_held) return;
+    realtime_suspend();
+    preload_pending = (pthread_create(&preload_thread, NULL, preload_main, NULL) == 0);
+    realtime_resume();
+}
+
+void audio_backend_shutdown(void) {
+    preload_join();
+    if (preload_held) {
+        Pa_Terminate();
+        preload_held = 0;
+    }
+}
+
+double audio_backend_init_seconds(void) {
+    preload_join();
+    return preload_held ? preload_seconds : 0.0;
+}
+#else
+// WASAPI and DirectSound expect Pa_Initialize() and Pa_Terminate() on the
+// same (COM-initialised) thread, so Windows initialises on demand
+static void preload_join(void) {
+}
+
+void audio_backend_preload(void) {
+}
+
+void audio_backend_shutdown(void) {
+}
+
+double audio_backend_init_seconds(void) {
+    return 0.0;
+}
+#endif
+
+int audio_backend_acquire(void) {
+    preload_join();
+
+    // Only bumps the reference count once the preload has finished. Some
+    // hosts (JACK, PipeWire) start their threads here.
+    realtime_suspend();
+    PaError err = Pa_Initialize();
+    realtime_resume();
+    if (err != paNoError) {
+        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
+        return 0;
+    }
+    return 1;
+}
+
+void audio_backend_release(void) {
+    Pa_Terminate();
+}
+
+int audio_backend_device_rate(void) {
+    if (!audio_backend_acquire()) {
+        return 0;
+    }
+    int rate = 0;
+    PaDeviceIndex device = Pa_GetDefaultOutputDevice();
+    if (device != paNoDevice) {
+        const PaDeviceInfo *info = Pa_GetDeviceInfo(device);
+        if (info) rate = (int)(info->defaultSampleRate + 0.5);
+    }
+    audio_backend_release();
+    return rate;
+}
@@ -1,60 +1,115 @@
 #include "audio_callback.h"
+#include "realtime.h"
+#include "timer.h"
 
-int audio_callback(const void *input, void *output,
-                   unsigned long frameCount,
-                   const PaStreamCallbackTimeInfo *timeInfo,
-                   PaStreamCallbackFlags statusFlags,
-                   void *userData) {
-    AudioData *data = (AudioData*)userData;
-    short *out = (short*)output;
-    unsigned long i;
-    
-    (void)input;
-    (void)timeInfo;
-    (void)statusFlags;
+// The newest queued sample reaches the DAC after this buffer and everything
+// still in the ring. Single writer, so plain load/store pairs are enough.
+static void record_latency(AudioData *data, const PaStreamCallbackTimeInfo *timeInfo,
+                           unsigned long frameCount, int full) {
+    long long dac_us = (long long)((timeInfo->outputBufferDacTime - data->stream_epoch) * 1e6);
+    if (atomic_load_explicit(&data->first_audio_us, memory_order_relaxed) < 0) {
+        atomic_store_explicit(&data->first_audio_us, dac_us, memory_order_relaxed);
+    }
+    if (!full) {
+        return;
+    }
+
+    size_t queued_frames = ring_buffer_available(&data->ring) / data->channels + frameCount;
+    double device = timeInfo->outputBufferDacTime - timeInfo->currentTime;
+    if (device < 0) device = 0;
+    long long latency = (long long)((device + (double)queued_frames / data->sample_rate) * 1e6);
 
+    atomic_store_explicit(&data->latency_us, latency, memory_order_relaxed);
+    if (latency > atomic_load_explicit(&data->latency_max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&data->latency_max_us, latency, memory_order_relaxed);
+    }
+    atomic_store_explicit(&data->latency_sum_us,
+                          atomic_load_explicit(&data->latency_sum_us, memory_order_relaxed) + latency,
+                          memory_order_relaxed);
+    atomic_store_explicit(&data->latency_count,
+                          atomic_load_explicit(&data->latency_count, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+static int fill_buffer(AudioData *data, short *out, unsigned long frameCount,
+                       const PaStreamCallbackTimeInfo *timeInfo) {
     // Check for stop signal
     if (stop_playback) {
         return paComplete;
     }
 
-    // Calculate available samples
-    int available = data->write_position - data->read_position;
-    
-    // If no data available
-    if (available <= 0) {
-        // If decoding is finished and no data left, we're done
-        if (data->decoding_finished) {
-            data->playback_finished = 1;
-            return paComplete;
+    // Sample the finished flag before the ring so the last write is never missed
+    int finished = data->decoding_finished;
+    int started = atomic_load_explicit(&data->first_audio_us, memory_order_relaxed) >= 0;
+
+    // Copy as much as is buffered (at most two contiguous spans)
+    size_t samples_needed = (size_t)frameCount * data->channels;
+    size_t samples_played = ring_buffer_read(&data->ring, out, samples_needed);
+    size_t queued = ring_buffer_available(&data->ring);
+
+    // Pairs with the fence in the producer's wait so a wakeup is never lost
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&data->producer_waiting, memory_order_relaxed) &&
+        queued <= data->low_water) {
+        atomic_store_explicit(&data->producer_waiting, 0, memory_order_relaxed);
+        wakeup_signal(&data->wakeup);
+    }
+
+    if (timeInfo && samples_played > 0) {
+        record_latency(data, timeInfo, frameCount, samples_played == samples_needed);
+    }
+
+    // The final drain is not a low point worth reporting
+    if (started && !finished) {
+        long long fill = (long long)(queued / data->channels);
+        long long low = atomic_load_explicit(&data->stats.fill_low_frames, memory_order_relaxed);
+        if (low < 0 || fill < low) {
+            atomic_store_explicit(&data->stats.fill_low_frames, fill, memory_order_relaxed);
         }
-        // Otherwise output silence and wait for more data
-        memset(out, 0, frameCount * data->channels * sizeof(short));
-        return paContinue;
-    }
-
-    // Calculate how many samples we can actually play
-    unsigned long samples_needed = frameCount * data->channels;
-    unsigned long samples_to_play = (available < (int)samples_needed) ? (unsigned long)available : samples_needed;
-    
-    // Copy audio data to output (with circular buffer support)
-    for (i = 0; i < samples_to_play; i++) {
-        out[i] = data->pcm_buffer[(data->read_position + i) % data->buffer_size];
-    }
-    
-    // Update read position
-    data->read_position += samples_to_play;
-    
+    }
+
     // Fill remaining with silence if needed
-    if (samples_to_play < samples_needed) {
-        memset(&out[samples_to_play], 0, (samples_needed - samples_to_play) * sizeof(short));
-        
+    if (samples_played < samples_needed) {
+        memset(&out[samples_played], 0, (samples_needed - samples_played) * sizeof(short));
+
         // If we couldn't fill the buffer and decoding is done, we're finishing
-        if (data->decoding_finished) {
+        if (finished) {
             data->playback_finished = 1;
+            wakeup_signal(&data->wakeup);
             return paComplete;
         }
+
+        // Startup priming is not a dropout
+        if (started) {
+            stats_add(&data->stats.silence_fills, 1);
+            stats_add(&data->stats.silence_frames, (samples_needed - samples_played) / data->channels);
+        }
     }
 
     return paContinue;
 }
+
+int audio_callback(const void *input, void *output,
+                   unsigned long frameCount,
+                   const PaStreamCallbackTimeInfo *timeInfo,
+                   PaStreamCallbackFlags statusFlags,
+                   void *userData) {
+    AudioData *data = (AudioData*)userData;
+    PlaybackStats *stats = &data->stats;
+    (void)input;
+
+    // The first call lifts PortAudio's thread above the decoder
+    realtime_callback();
+
+    // timer_now() reads a vDSO/QPC clock, not a syscall
+    double start = timer_now();
+
+    if (statusFlags & paOutputUnderflow) stats_add(&stats->underflows, 1);
+    if (statusFlags & paOutputOverflow) stats_add(&stats->overflows, 1);
+
+    int result = fill_buffer(data, (short*)output, frameCount, timeInfo);
+
+    stats_add(&stats->callbacks, 1);
+    stats_histogram_add(&stats->callback_time, timer_now() - start);
+    return result;
+}
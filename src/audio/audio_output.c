@@ -0,0 +1,976 @@
+#include "audio_output.h"
+#include "audio_callback.h"
+#include "audio_backend.h"
+#include "timer.h"
+#include "realtime.h"
+#include "pcm_convert.h"
+#include <math.h>
+
+#define MIN_BUFFER_MS 20
+#define PREBUFFER_MS 100
+#define WAKEUP_TIMEOUT_MS 250
+#define DRAIN_REPORT_MS 500
+#define DEFAULT_STATS_INTERVAL 1.0
+#define WAV_SIZE_UNKNOWN (~0ULL)
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+static void put_le16(unsigned char *p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void put_le32(unsigned char *p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+// Sizes are unknown until the end unless the input declares its length;
+// streams that cannot seek back otherwise keep 0xFFFFFFFF placeholders
+// (WAV_SIZE_UNKNOWN), which common readers treat as "until EOF". A real
+// length past 4 GB is clamped so the RIFF size still fits.
+static void write_wav_header(AudioOutput *out, unsigned long long data_bytes) {
+    unsigned char header[44];
+    unsigned int riff_size = 0xFFFFFFFFU;
+    unsigned int data_size = 0xFFFFFFFFU;
+    if (data_bytes != WAV_SIZE_UNKNOWN) {
+        data_size = (data_bytes > 0xFFFFFFFFULL - 36) ? 0xFFFFFFFFU - 36 : (unsigned int)data_bytes;
+        riff_size = data_size + 36;
+    }
+
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, riff_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le16(header + 20, 1);
+    put_le16(header + 22, out->channels);
+    put_le32(header + 24, out->sample_rate);
+    put_le32(header + 28, out->sample_rate * out->channels * sizeof(short));
+    put_le16(header + 32, out->channels * sizeof(short));
+    put_le16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, data_size);
+
+    fwrite(header, 1, sizeof(header), out->file);
+}
+
+static int open_file(AudioOutput *out) {
+    if (strcmp(out->config.path, "-") == 0) {
+        // Keep PCM on the real stdout and send all console messages to stderr
+        fflush(stdout);
+        int fd = dup(fileno(stdout));
+        if (fd < 0) return 0;
+        dup2(fileno(stderr), fileno(stdout));
+#ifdef _WIN32
+        _setmode(fd, _O_BINARY);
+#endif
+        out->file = fdopen(fd, "wb");
+        out->seekable = 0;
+    } else {
+        out->file = fopen(out->config.path, "wb");
+        out->seekable = 1;
+    }
+
+    if (!out->file) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", out->config.path);
+        return 0;
+    }
+
+    if (!out->config.raw) {
+        unsigned long long length = out->config.length_frames * out->channels * sizeof(short);
+        write_wav_header(out, (out->seekable || length) ? length : WAV_SIZE_UNKNOWN);
+    }
+    return 1;
+}
+
+static void free_converters(AudioOutput *out) {
+    resampler_free(out->resampler);
+    out->resampler = NULL;
+    free(out->resampled);
+    out->resampled = NULL;
+    downmix_free(out->downmix);
+    out->downmix = NULL;
+    free(out->downmixed);
+    out->downmixed = NULL;
+}
+
+// Streams with more channels than the device takes (or than asked for)
+// are folded down here, ahead of the resampler, so it has fewer channels
+// to filter
+static int choose_device_channels(AudioOutput *out, int device_channels) {
+    out->device_channels = device_channels;
+    if (out->device_channels == out->channels) {
+        return 1;
+    }
+
+    out->downmix = downmix_create(out->config.mapping_family, out->channels, out->device_channels);
+    out->downmixed = (short*)malloc(FRAME_SIZE * out->device_channels * sizeof(short));
+    if (!out->downmix || !out->downmixed) {
+        fprintf(stderr, "Error: Failed to set up downmix\n");
+        free_converters(out);
+        return 0;
+    }
+    return 1;
+}
+
+// The stream runs at the device's own rate (or the one asked for), so the
+// host's mixer has nothing left to convert. A decode rate that differs is
+// resampled here; if the ratio is beyond the resampler, the stream runs at
+// the decode rate and the host converts after all.
+static int choose_device_rate(AudioOutput *out, int rate) {
+    out->device_rate = (rate > 0) ? rate : out->sample_rate;
+    if (out->device_rate == out->sample_rate) {
+        return 1;
+    }
+
+    out->resampler = resampler_create(out->sample_rate, out->device_rate, out->device_channels);
+    if (!out->resampler && out->config.mixer_source) {
+        // The mixer has no host to fall back on
+        fprintf(stderr, "Error: Cannot resample %d Hz to the mixer's %d Hz\n", out->sample_rate, out->device_rate);
+        free_converters(out);
+        return 0;
+    }
+    if (!out->resampler) {
+        fprintf(stderr, "Warning: Cannot resample %d Hz to %d Hz; the host will convert\n",
+                out->sample_rate, out->device_rate);
+        out->device_rate = out->sample_rate;
+        return 1;
+    }
+    out->resampled = (short*)malloc(resampler_max_output(out->resampler, FRAME_SIZE) * out->device_channels *
+                                    sizeof(short));
+    if (!out->resampled) {
+        fprintf(stderr, "Error: Failed to allocate resampler buffer\n");
+        free_converters(out);
+        return 0;
+    }
+    return 1;
+}
+
+// Sets up the ring: the configured depth plus one frame, at the device
+// rate and channel count (short inputs of known length get a smaller ring)
+static int init_ring(AudioOutput *out) {
+    AudioData *audio_data = &out->audio_data;
+    int buffer_ms = out->config.buffer_ms > 0 ? out->config.buffer_ms : DEFAULT_BUFFER_MS;
+    if (buffer_ms < MIN_BUFFER_MS) buffer_ms = MIN_BUFFER_MS;
+    size_t depth_frames = (size_t)out->device_rate * buffer_ms / 1000;
+    size_t length_frames = (size_t)(out->config.length_frames * out->device_rate / out->sample_rate);
+    if (length_frames && length_frames < depth_frames) {
+        depth_frames = length_frames;
+    }
+    size_t frame_room = out->resampler ? resampler_max_output(out->resampler, FRAME_SIZE) : FRAME_SIZE;
+    if (!ring_buffer_init(&audio_data->ring, (depth_frames + frame_room) * out->device_channels)) {
+        fprintf(stderr, "Error: Failed to allocate audio buffer\n");
+        return 0;
+    }
+    if (!wakeup_init(&audio_data->wakeup)) {
+        fprintf(stderr, "Error: Failed to create wakeup event\n");
+        ring_buffer_free(&audio_data->ring);
+        return 0;
+    }
+    audio_data->channels = out->device_channels;
+    audio_data->sample_rate = out->device_rate;
+    audio_data->decoding_finished = 0;
+    audio_data->playback_finished = 0;
+    atomic_init(&audio_data->producer_waiting, 0);
+    atomic_init(&audio_data->first_audio_us, -1);
+    atomic_init(&audio_data->latency_us, 0);
+    atomic_init(&audio_data->latency_max_us, 0);
+    atomic_init(&audio_data->latency_sum_us, 0);
+    atomic_init(&audio_data->latency_count, 0);
+
+    // Refill from low to high watermark: one wakeup per quarter of the depth
+    out->max_buffered = depth_frames * out->device_channels;
+    audio_data->low_water = out->max_buffered * 3 / 4;
+
+    // The stream starts once this much is decoded, so the first callback
+    // already finds audio
+    size_t prebuffer_frames = (size_t)out->device_rate * PREBUFFER_MS / 1000;
+    out->prebuffer = (prebuffer_frames < depth_frames ? prebuffer_frames : depth_frames) * out->device_channels;
+    return 1;
+}
+
+// A mixer source has no stream of its own: the mixer's callback drains its
+// ring, which must match the mixer's rate and channel count exactly (set
+// in device_rate and device_channels)
+static int open_mixer_source(AudioOutput *out) {
+    if (!choose_device_channels(out, out->config.device_channels) ||
+        !choose_device_rate(out, out->config.device_rate)) {
+        return 0;
+    }
+    if (!init_ring(out)) {
+        free_converters(out);
+        return 0;
+    }
+    mixer_source_bind(out->config.mixer_source, &out->audio_data);
+    return 1;
+}
+
+// The callback runs on the producer's thread, from a virtual clock. The
+// device takes as many channels as the stream has unless limited.
+static int open_simulated(AudioOutput *out) {
+    int limit = out->config.device_channels;
+    int rate = out->config.device_rate > 0 ? out->config.device_rate : SIM_DEFAULT_RATE;
+    if (!choose_device_channels(out, (limit > 0 && limit < out->channels) ? limit : out->channels) ||
+        !choose_device_rate(out, rate)) {
+        return 0;
+    }
+    if (!init_ring(out)) {
+        free_converters(out);
+        return 0;
+    }
+
+    unsigned long frames_per_buffer = out->config.frames_per_buffer > 0
+        ? (unsigned long)out->config.frames_per_buffer : DEFAULT_FRAMES_PER_BUFFER;
+    double latency = out->config.latency_ms > 0 ? out->config.latency_ms / 1000.0
+                                                : 2.0 * frames_per_buffer / out->device_rate;
+    out->sim = sim_device_create(out->config.simulate, &out->audio_data, out->device_rate, out->device_channels,
+                                 frames_per_buffer, latency);
+    if (!out->sim) {
+        wakeup_free(&out->audio_data.wakeup);
+        ring_buffer_free(&out->audio_data.ring);
+        free_converters(out);
+        return 0;
+    }
+
+    size_t depth_frames = out->max_buffered / out->device_channels;
+    printf("Using simulated device (%d Hz, %d channels)\n", out->device_rate, out->device_channels);
+    if (out->downmix) {
+        printf("Downmixing: %d -> %d channels (%s)\n", out->channels, out->device_channels,
+               downmix_kernel(out->downmix));
+    }
+    if (out->resampler) {
+        printf("Resampling: %d Hz -> %d Hz (%d taps, %s)\n", out->sample_rate, out->device_rate,
+               resampler_taps(out->resampler), resampler_kernel());
+    }
+    printf("Output latency: %.1f ms | Buffer: %lu frames | Queue: %zu ms | Prebuffer: %zu ms\n\n",
+           latency * 1000.0, frames_per_buffer, depth_frames * 1000 / out->device_rate,
+           out->prebuffer / out->device_channels * 1000 / out->device_rate);
+    return 1;
+}
+
+static int open_device(AudioOutput *out) {
+    if (out->config.mixer_source) {
+        return open_mixer_source(out);
+    }
+    if (out->config.simulate) {
+        return open_simulated(out);
+    }
+
+    // Usually already done by the preload thread
+    if (!audio_backend_acquire()) {
+        return 0;
+    }
+
+    PaStreamParameters outputParameters;
+    outputParameters.device = Pa_GetDefaultOutputDevice();
+    if (outputParameters.device == paNoDevice) {
+        fprintf(stderr, "Error: No default output device.\n");
+        audio_backend_release();
+        return 0;
+    }
+    const PaDeviceInfo *device = Pa_GetDeviceInfo(outputParameters.device);
+    int limit = out->config.device_channels > 0 ? out->config.device_channels : device->maxOutputChannels;
+    int rate = out->config.device_rate > 0 ? out->config.device_rate : (int)(device->defaultSampleRate + 0.5);
+    if (!choose_device_channels(out, (limit > 0 && limit < out->channels) ? limit : out->channels) ||
+        !choose_device_rate(out, rate)) {
+        audio_backend_release();
+        return 0;
+    }
+
+    AudioData *audio_data = &out->audio_data;
+    if (!init_ring(out)) {
+        free_converters(out);
+        audio_backend_release();
+        return 0;
+    }
+    size_t depth_frames = out->max_buffered / out->device_channels;
+
+    // Open audio stream
+    outputParameters.channelCount = out->device_channels;
+    outputParameters.sampleFormat = paInt16;
+    outputParameters.suggestedLatency = (out->config.latency_ms > 0)
+        ? out->config.latency_ms / 1000.0
+        : device->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    unsigned long frames_per_buffer = DEFAULT_FRAMES_PER_BUFFER;
+    if (out->config.frames_per_buffer > 0) {
+        frames_per_buffer = (unsigned long)out->config.frames_per_buffer;
+    } else if (out->config.frames_per_buffer < 0) {
+        frames_per_buffer = paFramesPerBufferUnspecified;
+    }
+
+    printf("Using audio device: %s (%d Hz)\n", device->name, out->device_rate);
+    if (out->downmix) {
+        printf("Downmixing: %d -> %d channels (%s)\n", out->channels, out->device_channels,
+               downmix_kernel(out->downmix));
+    }
+    if (out->resampler) {
+        printf("Resampling: %d Hz -> %d Hz (%d taps, %s)\n", out->sample_rate, out->device_rate,
+               resampler_taps(out->resampler), resampler_kernel());
+    }
+
+    // PortAudio's callback thread must not inherit the decoder's pinning; it
+    // sets its own priority on the first callback (realtime_callback())
+    realtime_suspend();
+    PaError err = Pa_OpenStream(&out->stream, NULL, &outputParameters, out->device_rate,
+                        frames_per_buffer, paClipOff, audio_callback, audio_data);
+    realtime_resume();
+
+    if (err != paNoError) {
+        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
+        wakeup_free(&audio_data->wakeup);
+        ring_buffer_free(&audio_data->ring);
+        free_converters(out);
+        audio_backend_release();
+        return 0;
+    }
+
+    const PaStreamInfo *info = Pa_GetStreamInfo(out->stream);
+    char buffer_text[32] = "auto";
+    if (frames_per_buffer != paFramesPerBufferUnspecified) {
+        snprintf(buffer_text, sizeof(buffer_text), "%lu frames", frames_per_buffer);
+    }
+    printf("Output latency: %.1f ms | Buffer: %s | Queue: %zu ms | Prebuffer: %zu ms\n\n",
+           info ? info->outputLatency * 1000.0 : 0.0, buffer_text,
+           depth_frames * 1000 / out->device_rate,
+           out->prebuffer / out->device_channels * 1000 / out->device_rate);
+
+    return 1;
+}
+
+// Starts the device once the prebuffer is decoded, or earlier when
+// decoding finishes or the producer would block
+static void start_device(AudioOutput *out) {
+    AudioData *audio_data = &out->audio_data;
+
+    // Callback times are measured from here
+    out->stream_started = 1;
+    if (out->config.mixer_source) {
+        audio_data->stream_epoch = mixer_source_time(out->config.mixer_source);
+        out->stream_start_time = timer_now();
+        mixer_source_start(out->config.mixer_source);
+        return;
+    }
+    if (out->sim) {
+        audio_data->stream_epoch = sim_device_time(out->sim);
+        out->stream_start_time = timer_now();
+        sim_device_start(out->sim);
+        return;
+    }
+    audio_data->stream_epoch = Pa_GetStreamTime(out->stream);
+    out->stream_start_time = timer_now();
+    realtime_suspend();
+    PaError err = Pa_StartStream(out->stream);
+    realtime_resume();
+    if (err != paNoError) {
+        fprintf(stderr, "PortAudio start error: %s\n", Pa_GetErrorText(err));
+        // Nothing will drain the ring; let the producer run into the stop
+        out->stream_started = 0;
+        stop_playback = 1;
+    }
+}
+
+static void start_if_prebuffered(AudioOutput *out) {
+    if (!out->stream_started && ring_buffer_available(&out->audio_data.ring) >= out->prebuffer) {
+        start_device(out);
+    }
+}
+
+static void lock_buffer(AudioOutput *out, void *data, size_t bytes) {
+    if (!data || bytes == 0) return;
+    if (realtime_lock(data, bytes)) {
+        out->locked_bytes += bytes;
+    } else {
+        out->prefaulted_bytes += bytes;
+    }
+}
+
+// Realtime mode: faults in every buffer the decoder or callback touches
+// per frame now (the ring is calloc'd, so its pages would otherwise first
+// be touched during playback) and locks what the limit allows. Nothing is
+// unlocked on close: the ring's own mapping goes with it, and small blocks
+// are reused by the next output.
+static void lock_buffers(AudioOutput *out) {
+    lock_buffer(out, out->audio_data.ring.data, out->audio_data.ring.capacity * sizeof(short));
+    lock_buffer(out, out->scratch, FRAME_SIZE * out->channels * sizeof(short));
+    lock_buffer(out, out->float_scratch, FRAME_SIZE * out->channels * sizeof(float));
+    lock_buffer(out, out->downmixed, FRAME_SIZE * out->device_channels * sizeof(short));
+    if (out->resampler) {
+        lock_buffer(out, out->resampled,
+                    resampler_max_output(out->resampler, FRAME_SIZE) * out->device_channels * sizeof(short));
+    }
+}
+
+// Stats are timed on the virtual clock when simulating
+static double output_clock(AudioOutput *out) {
+    return out->sim ? sim_device_time(out->sim) : timer_now();
+}
+
+int audio_output_open(AudioOutput *out, const OutputConfig *config, int sample_rate, int channels) {
+    memset(out, 0, sizeof(*out));
+    out->config = *config;
+    out->sample_rate = sample_rate;
+    out->device_rate = sample_rate;
+    out->channels = channels;
+    out->device_channels = channels;
+    out->end_position = -1;
+
+    out->scratch = (config->scratch && channels <= 2) ? config->scratch
+                                                      : (short*)malloc(FRAME_SIZE * channels * sizeof(short));
+    if (!out->scratch) {
+        fprintf(stderr, "Error: Failed to allocate decode buffer\n");
+        return 0;
+    }
+
+    // Software volume and dither need the float path; it is opt-in otherwise
+    out->use_float = config->float_pcm || config->volume_db != 0.0 || config->dither;
+    audio_output_set_gain(out, 0);
+    if (out->use_float) {
+        out->float_scratch = (float*)malloc(FRAME_SIZE * channels * sizeof(float));
+        out->dither = config->dither ? (PcmDither*)malloc(sizeof(PcmDither)) : NULL;
+        if (!out->float_scratch || (config->dither && !out->dither)) {
+            fprintf(stderr, "Error: Failed to allocate decode buffer\n");
+            free(out->float_scratch);
+            free(out->dither);
+            if (out->scratch != config->scratch) free(out->scratch);
+            return 0;
+        }
+        if (out->dither) pcm_dither_init(out->dither, 1);
+    }
+
+    stats_init(&out->audio_data.stats);
+    if (config->stats_json) {
+        out->stats_file = (strcmp(config->stats_json, "-") == 0) ? stderr : fopen(config->stats_json, "w");
+        if (!out->stats_file) {
+            fprintf(stderr, "Warning: Cannot create stats file '%s'\n", config->stats_json);
+        }
+    }
+
+    int ok = 1;
+    switch (config->mode) {
+    case OUTPUT_DEVICE:
+        ok = open_device(out);
+        break;
+    case OUTPUT_FILE:
+        ok = open_file(out);
+        break;
+    case OUTPUT_NULL:
+        break;
+    }
+
+    if (!ok) {
+        if (out->scratch != config->scratch) free(out->scratch);
+        out->scratch = NULL;
+        free(out->float_scratch);
+        free(out->dither);
+        if (out->stats_file && out->stats_file != stderr) fclose(out->stats_file);
+        return 0;
+    }
+
+    if (config->mode == OUTPUT_DEVICE && config->realtime) {
+        lock_buffers(out);
+    }
+
+    out->start_time = output_clock(out);
+    out->next_stats = out->start_time;
+    return 1;
+}
+
+void audio_output_close(AudioOutput *out) {
+    if (out->config.mode == OUTPUT_DEVICE) {
+        if (out->config.mixer_source) {
+            mixer_source_unbind(out->config.mixer_source);
+        } else if (out->sim) {
+            sim_device_free(out->sim);
+            out->sim = NULL;
+        } else {
+            if (out->stream_started) {
+                Pa_StopStream(out->stream);
+            }
+            Pa_CloseStream(out->stream);
+            audio_backend_release();
+        }
+        wakeup_free(&out->audio_data.wakeup);
+        ring_buffer_free(&out->audio_data.ring);
+        free_converters(out);
+    }
+
+    if (out->file) {
+        if (!out->config.raw && out->seekable && fseek(out->file, 0, SEEK_SET) == 0) {
+            write_wav_header(out, out->frames_written * out->channels * sizeof(short));
+        }
+        fclose(out->file);
+        out->file = NULL;
+    }
+
+    if (out->stats_file && out->stats_file != stderr) {
+        fclose(out->stats_file);
+    }
+    out->stats_file = NULL;
+
+    if (out->scratch != out->config.scratch) free(out->scratch);
+    out->scratch = NULL;
+    free(out->float_scratch);
+    out->float_scratch = NULL;
+    free(out->dither);
+    out->dither = NULL;
+}
+
+int audio_output_stopped(const AudioOutput *out) {
+    return stop_playback || (out->config.mixer_source && mixer_source_cancelled(out->config.mixer_source));
+}
+
+static int wait_for_callback(AudioOutput *out, int timeout_ms) {
+    if (out->sim) {
+        return sim_device_wait(out->sim, timeout_ms);
+    }
+    return wakeup_wait(&out->audio_data.wakeup, timeout_ms);
+}
+
+// A simulated device drains the ring for as long as the packets would
+// have taken to decode
+static void charge_decode(AudioOutput *out, unsigned long long packets, size_t frames) {
+    if (out->sim) {
+        sim_device_decoded(out->sim, packets, (double)frames / out->sample_rate);
+    }
+}
+
+// Blocks while more than max_buffered samples are queued, until the
+// callback reports the ring has drained to its low watermark
+static void wait_for_space(AudioOutput *out) {
+    AudioData *data = &out->audio_data;
+    if (!out->stream_started && ring_buffer_available(&data->ring) > out->max_buffered) {
+        start_device(out);
+    }
+    while (ring_buffer_available(&data->ring) > out->max_buffered && !audio_output_stopped(out)) {
+        atomic_store(&data->producer_waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (ring_buffer_available(&data->ring) <= out->max_buffered) {
+            break;
+        }
+        // The timeout only matters if the stream stops calling back
+        wait_for_callback(out, WAKEUP_TIMEOUT_MS);
+    }
+    atomic_store(&data->producer_waiting, 0);
+}
+
+short *audio_output_reserve(AudioOutput *out) {
+    if (out->config.mode != OUTPUT_DEVICE) {
+        out->reserved = out->scratch;
+        return out->reserved;
+    }
+
+    RingBuffer *ring = &out->audio_data.ring;
+    wait_for_space(out);
+
+    // Decode straight into the ring when a whole frame fits contiguously
+    // (resampled or downmixed audio is written by the converter instead)
+    short *span;
+    out->direct = !out->resampler && !out->downmix &&
+                  ring_buffer_write_reserve(ring, &span) >= (size_t)FRAME_SIZE * out->channels;
+    out->reserved = out->direct ? span : out->scratch;
+    return out->reserved;
+}
+
+// Consumes pending skip_frames from the front of a block of frames
+static size_t take_skip(AudioOutput *out, size_t frames) {
+    if (out->skip_frames == 0) return 0;
+    size_t drop = (out->skip_frames < frames) ? (size_t)out->skip_frames : frames;
+    out->skip_frames -= drop;
+    return drop;
+}
+
+// How many of frames fall before end_position
+static size_t clip_to_end(AudioOutput *out, size_t frames) {
+    if (out->end_position < 0) return frames;
+    long long room = out->end_position - (out->timeline_offset + (long long)out->frames_written);
+    if (room <= 0) return 0;
+    return ((unsigned long long)room < frames) ? (size_t)room : frames;
+}
+
+// Converts frames (at most FRAME_SIZE) to the device rate and queues them
+static void queue_resampled(AudioOutput *out, const short *pcm, size_t frames) {
+    if (out->downmix) {
+        downmix_process(out->downmix, pcm, out->downmixed, frames);
+        pcm = out->downmixed;
+    }
+    size_t samples = resampler_process(out->resampler, pcm, frames, out->resampled) * out->device_channels;
+    size_t written = ring_buffer_write(&out->audio_data.ring, out->resampled, samples);
+    if (written < samples) {
+        stats_add(&out->audio_data.stats.dropped_samples, samples - written);
+    }
+}
+
+// Folds frames down straight into the ring's free span, which takes the
+// place of the copy into the ring; only a frame split by the wrap goes
+// through downmixed
+static void queue_downmixed(AudioOutput *out, const short *pcm, size_t frames) {
+    RingBuffer *ring = &out->audio_data.ring;
+    size_t out_channels = (size_t)out->device_channels;
+    while (frames > 0) {
+        short *span;
+        size_t n = ring_buffer_write_reserve(ring, &span) / out_channels;
+        if (n > 0) {
+            if (n > frames) n = frames;
+            downmix_process(out->downmix, pcm, span, n);
+            ring_buffer_write_commit(ring, n * out_channels);
+        } else if (ring_buffer_space(ring) >= out_channels) {
+            n = 1;
+            downmix_process(out->downmix, pcm, out->downmixed, 1);
+            ring_buffer_write(ring, out->downmixed, out_channels);
+        } else {
+            break;
+        }
+        pcm += n * out->channels;
+        frames -= n;
+    }
+    if (frames > 0) {
+        stats_add(&out->audio_data.stats.dropped_samples, frames * out_channels);
+    }
+}
+
+// Publishes frames from the reserved buffer, which pcm points into
+static void commit_frames(AudioOutput *out, const short *pcm, int frames) {
+    frames = (int)clip_to_end(out, (size_t)frames);
+    if (frames == 0) return;
+
+    size_t samples = (size_t)frames * out->channels;
+
+    switch (out->config.mode) {
+    case OUTPUT_DEVICE:
+        if (out->resampler) {
+            queue_resampled(out, pcm, (size_t)frames);
+        } else if (out->downmix) {
+            queue_downmixed(out, pcm, (size_t)frames);
+        } else if (out->direct) {
+            ring_buffer_write_commit(&out->audio_data.ring, samples);
+        } else {
+            size_t written = ring_buffer_write(&out->audio_data.ring, pcm, samples);
+            if (written < samples) {
+                stats_add(&out->audio_data.stats.dropped_samples, samples - written);
+            }
+        }
+        start_if_prebuffered(out);
+        break;
+    case OUTPUT_FILE:
+        fwrite(pcm, sizeof(short), samples, out->file);
+        break;
+    case OUTPUT_NULL:
+        break;
+    }
+
+    out->frames_written += frames;
+}
+
+void audio_output_commit(AudioOutput *out, int frames) {
+    short *pcm = out->reserved;
+    out->packets++;
+    charge_decode(out, 1, frames);
+
+    int drop = (int)take_skip(out, frames);
+    frames -= drop;
+    if (frames == 0) return;
+
+    if (drop > 0) {
+        // The ring commit publishes from the reserved span's start
+        if (out->direct) {
+            memmove(pcm, pcm + (size_t)drop * out->channels, (size_t)frames * out->channels * sizeof(short));
+        } else {
+            pcm += (size_t)drop * out->channels;
+        }
+    }
+
+    commit_frames(out, pcm, frames);
+}
+
+float *audio_output_reserve_float(AudioOutput *out) {
+    audio_output_reserve(out);
+    return out->float_scratch;
+}
+
+void audio_output_commit_float(AudioOutput *out, int frames) {
+    out->packets++;
+    charge_decode(out, 1, frames);
+
+    int drop = (int)take_skip(out, frames);
+    frames -= drop;
+    if (frames == 0) return;
+
+    // Gain, volume, dither and clipping in the same pass that narrows to int16
+    pcm_float_to_s16(out->float_scratch + (size_t)drop * out->channels, out->reserved,
+                     (size_t)frames * out->channels, out->scale, out->dither);
+    commit_frames(out, out->reserved, frames);
+}
+
+void audio_output_set_gain(AudioOutput *out, int gain) {
+    out->scale = powf(10.0f, (float)(out->config.volume_db + gain / 256.0) / 20.0f);
+}
+
+void audio_output_skip(AudioOutput *out, unsigned long long frames) {
+    out->skip_frames = frames;
+}
+
+void audio_output_flush(AudioOutput *out) {
+    if (out->config.mode == OUTPUT_DEVICE) {
+        ring_buffer_discard(&out->audio_data.ring);
+        if (out->resampler) resampler_reset(out->resampler);
+    }
+}
+
+void audio_output_write(AudioOutput *out, const short *pcm, size_t frames, unsigned long long packets) {
+    charge_decode(out, packets, frames);
+    size_t drop = take_skip(out, frames);
+    pcm += drop * out->channels;
+    frames = clip_to_end(out, frames - drop);
+    size_t samples = frames * out->channels;
+
+    switch (out->config.mode) {
+    case OUTPUT_DEVICE:
+        if (out->resampler || out->downmix) {
+            // At most one frame per step, which the ring always has room for
+            for (size_t done = 0; done < frames && !audio_output_stopped(out); ) {
+                size_t slice = (frames - done < FRAME_SIZE) ? frames - done : FRAME_SIZE;
+                wait_for_space(out);
+                if (out->resampler) {
+                    queue_resampled(out, pcm + done * out->channels, slice);
+                } else {
+                    queue_downmixed(out, pcm + done * out->channels, slice);
+                }
+                done += slice;
+            }
+        } else {
+            while (samples > 0 && !audio_output_stopped(out)) {
+                wait_for_space(out);
+                size_t written = ring_buffer_write(&out->audio_data.ring, pcm, samples);
+                pcm += written;
+                samples -= written;
+            }
+        }
+        start_if_prebuffered(out);
+        break;
+    case OUTPUT_FILE:
+        fwrite(pcm, sizeof(short), samples, out->file);
+        break;
+    case OUTPUT_NULL:
+        break;
+    }
+
+    out->frames_written += frames;
+    out->packets += packets;
+}
+
+void audio_output_set_position(AudioOutput *out, long long frames) {
+    out->timeline_offset = frames - (long long)out->frames_written;
+}
+
+void audio_output_set_end(AudioOutput *out, long long frames) {
+    out->end_position = frames;
+}
+
+long long audio_output_play_position(AudioOutput *out) {
+    long long written = out->timeline_offset + (long long)out->frames_written;
+    if (out->config.mode != OUTPUT_DEVICE) {
+        return written;
+    }
+    long long queued = (long long)(ring_buffer_available(&out->audio_data.ring) / out->device_channels);
+    return written - queued * out->sample_rate / out->device_rate;
+}
+
+double audio_output_buffered(AudioOutput *out) {
+    if (out->config.mode != OUTPUT_DEVICE) {
+        return 0.0;
+    }
+    return (double)ring_buffer_available(&out->audio_data.ring) / ((double)out->device_rate * out->device_channels);
+}
+
+// One JSON object per line, so the file can be tailed while playing
+static void write_stats(AudioOutput *out, double now) {
+    AudioData *data = &out->audio_data;
+    PlaybackStats *stats = &data->stats;
+    FILE *f = out->stats_file;
+    long long low = atomic_load_explicit(&stats->fill_low_frames, memory_order_relaxed);
+    double fill = (out->config.mode == OUTPUT_DEVICE) ? audio_output_buffered(out) : 0.0;
+
+    fprintf(f, "{\"t\":%.3f,\"callbacks\":%llu,\"underruns\":%llu,\"overflows\":%llu,"
+               "\"silence_fills\":%llu,\"silence_frames\":%llu,\"dropped_samples\":%llu,"
+               "\"fill_ms\":%.1f,\"fill_low_ms\":%.1f,\"latency_ms\":%.1f,\"callback\":",
+            now - out->start_time,
+            atomic_load_explicit(&stats->callbacks, memory_order_relaxed),
+            atomic_load_explicit(&stats->underflows, memory_order_relaxed),
+            atomic_load_explicit(&stats->overflows, memory_order_relaxed),
+            atomic_load_explicit(&stats->silence_fills, memory_order_relaxed),
+            atomic_load_explicit(&stats->silence_frames, memory_order_relaxed),
+            atomic_load_explicit(&stats->dropped_samples, memory_order_relaxed),
+            fill * 1000.0, low >= 0 ? low * 1000.0 / out->device_rate : -1.0,
+            atomic_load_explicit(&data->latency_us, memory_order_relaxed) / 1000.0);
+    stats_histogram_json(f, &stats->callback_time);
+    fprintf(f, ",\"decode\":");
+    stats_histogram_json(f, &stats->decode_time);
+    fprintf(f, "}\n");
+    fflush(f);
+}
+
+static void stats_tick(AudioOutput *out) {
+    if (!out->stats_file) return;
+
+    double now = output_clock(out);
+    if (now < out->next_stats) return;
+
+    double interval = out->config.stats_interval > 0 ? out->config.stats_interval : DEFAULT_STATS_INTERVAL;
+    out->next_stats = now + interval;
+    write_stats(out, now);
+}
+
+void audio_output_progress(AudioOutput *out) {
+    stats_tick(out);
+
+    // Headless runs are not paced by a device; a status line per 50
+    // packets would only slow them down, as it would a simulation. Mixer
+    // sources share the console.
+    if (out->config.mode != OUTPUT_DEVICE || out->config.mixer_source || out->sim || out->packets % 50 != 0) {
+        return;
+    }
+
+    printf("\rDecoded: %.2f sec | Buffered: %.2f sec | Latency: %.1f ms | Playing...",
+           (double)(out->timeline_offset + (long long)out->frames_written) / out->sample_rate,
+           audio_output_buffered(out), atomic_load(&out->audio_data.latency_us) / 1000.0);
+    fflush(stdout);
+}
+
+void audio_output_finish(AudioOutput *out) {
+    if (out->config.mode != OUTPUT_DEVICE) {
+        if (out->file) fflush(out->file);
+        return;
+    }
+
+    // The resampler still holds its look-ahead of the last frames
+    if (out->resampler && !audio_output_stopped(out)) {
+        wait_for_space(out);
+        size_t samples = resampler_drain(out->resampler, out->resampled) * out->device_channels;
+        ring_buffer_write(&out->audio_data.ring, out->resampled, samples);
+    }
+
+    // Mark decoding as finished; a short input may not have filled the prebuffer
+    out->audio_data.decoding_finished = 1;
+    if (!out->stream_started) {
+        start_device(out);
+    }
+    int verbose = !out->config.mixer_source;
+    if (verbose) {
+        printf("\n\nDecoding finished, waiting for playback to complete...\n");
+    }
+
+    // Wait for playback to finish; the callback signals when it completes
+    while (!out->audio_data.playback_finished && !audio_output_stopped(out)) {
+        wait_for_callback(out, DRAIN_REPORT_MS);
+        stats_tick(out);
+        double remaining = audio_output_buffered(out);
+        if (remaining > 0 && verbose) {
+            printf("\rRemaining: %.2f seconds", remaining);
+            fflush(stdout);
+        }
+    }
+
+    if (verbose) {
+        printf("\n✓ Playback finished\n");
+    }
+}
+
+static void report_latency(AudioOutput *out) {
+    AudioData *data = &out->audio_data;
+    long long first = atomic_load(&data->first_audio_us);
+    long long count = atomic_load(&data->latency_count);
+
+    printf("\n=== Latency ===\n");
+    if (first >= 0) {
+        printf("First audio: %.1f ms after stream start\n", first / 1000.0);
+    }
+    if (first >= 0 && out->config.launch_time > 0 && !out->sim) {
+        // first_audio_us is a DAC time on the stream clock, relative to the start
+        double first_sample = out->stream_start_time + first / 1e6 - out->config.launch_time;
+        double backend = audio_backend_init_seconds();
+        printf("Time to first sample: %.1f ms after launch (stream started at %.1f ms",
+               first_sample * 1000.0, (out->stream_start_time - out->config.launch_time) * 1000.0);
+        if (backend > 0) {
+            printf(", backend init %.1f ms in the background", backend * 1000.0);
+        }
+        printf(")\n");
+    }
+    if (count > 0) {
+        printf("Output latency: %.1f ms avg, %.1f ms max (%lld buffers)\n",
+               atomic_load(&data->latency_sum_us) / 1000.0 / count,
+               atomic_load(&data->latency_max_us) / 1000.0, count);
+    }
+}
+
+static void report_stats(AudioOutput *out) {
+    PlaybackStats *stats = &out->audio_data.stats;
+
+    printf("\n=== Playback Stats ===\n");
+    if (out->config.mode == OUTPUT_DEVICE) {
+        long long low = atomic_load(&stats->fill_low_frames);
+        printf("Callbacks: %llu | Underruns: %llu | Overflows: %llu\n",
+               atomic_load(&stats->callbacks), atomic_load(&stats->underflows),
+               atomic_load(&stats->overflows));
+        printf("Silence: %llu buffers, %.1f ms | Dropped: %llu samples\n",
+               atomic_load(&stats->silence_fills),
+               atomic_load(&stats->silence_frames) * 1000.0 / out->device_rate,
+               atomic_load(&stats->dropped_samples));
+        if (low >= 0) {
+            printf("Lowest queue: %.1f ms\n", low * 1000.0 / out->device_rate);
+        }
+        printf("Callback time: p50 <%u us, p99 <%u us, max %u us\n",
+               stats_histogram_percentile(&stats->callback_time, 0.5),
+               stats_histogram_percentile(&stats->callback_time, 0.99),
+               atomic_load(&stats->callback_time.max_us));
+    }
+    if (atomic_load(&stats->decode_time.count) > 0) {
+        printf("Decode time: p50 <%u us, p99 <%u us, max %u us per packet\n",
+               stats_histogram_percentile(&stats->decode_time, 0.5),
+               stats_histogram_percentile(&stats->decode_time, 0.99),
+               atomic_load(&stats->decode_time.max_us));
+    }
+}
+
+void audio_output_report(AudioOutput *out, unsigned long long input_bytes) {
+    if (out->stats_file) {
+        write_stats(out, output_clock(out));
+    }
+    if (out->config.stats) {
+        report_stats(out);
+    }
+
+    if (out->config.mode == OUTPUT_DEVICE) {
+        report_latency(out);
+        if (out->sim) {
+            sim_device_report(out->sim);
+        }
+        if (out->config.realtime) {
+            printf("Locked buffers: %zu KB", out->locked_bytes / 1024);
+            if (out->prefaulted_bytes > 0) {
+                printf(" (%zu KB more pre-faulted but not locked)", out->prefaulted_bytes / 1024);
+            }
+            printf("\n");
+        }
+        return;
+    }
+
+    double elapsed = timer_now() - out->start_time;
+    double audio_seconds = (double)out->frames_written / out->sample_rate;
+    double pcm_bytes = (double)out->frames_written * out->channels * sizeof(short);
+    if (elapsed <= 0) elapsed = 1e-9;
+
+    printf("\n=== Decode Summary ===\n");
+    printf("Audio: %.2f sec in %.3f sec (%.1fx realtime)\n", audio_seconds, elapsed, audio_seconds / elapsed);
+    printf("Packets: %llu (%.0f packets/s)\n", out->packets, out->packets / elapsed);
+    printf("Throughput: %.2f MB/s input, %.2f MB/s PCM\n",
+           input_bytes / elapsed / 1e6, pcm_bytes / elapsed / 1e6);
+}
@@ -0,0 +1,315 @@
+#include "downmix.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DOWNMIX_HAVE_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DOWNMIX_HAVE_AVX2 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define DOWNMIX_HAVE_NEON 1
+#endif
+
+#define SIMD_MAX_OUT 8        // output channels the vector kernels hold in registers
+#define MINUS_3DB 0.70710678f
+
+// Converts the frames it can and returns how many; the rest go through
+// the scalar loop
+typedef size_t (*MixKernel)(const Downmix *d, const short *in, short *out, size_t frames);
+
+struct Downmix {
+    int in_channels;
+    int out_channels;
+    float *matrix;            // in_channels rows of out_channels gains
+    MixKernel kernel;
+    const char *kernel_name;
+};
+
+// Vorbis channel order, by channel count
+enum { SPK_FL, SPK_FR, SPK_FC, SPK_LFE, SPK_RL, SPK_RR, SPK_SL, SPK_SR, SPK_RC };
+
+static const int vorbis_layouts[9][8] = {
+    { 0 },
+    { SPK_FC },
+    { SPK_FL, SPK_FR },
+    { SPK_FL, SPK_FC, SPK_FR },
+    { SPK_FL, SPK_FR, SPK_RL, SPK_RR },
+    { SPK_FL, SPK_FC, SPK_FR, SPK_RL, SPK_RR },
+    { SPK_FL, SPK_FC, SPK_FR, SPK_RL, SPK_RR, SPK_LFE },
+    { SPK_FL, SPK_FC, SPK_FR, SPK_SL, SPK_SR, SPK_RC, SPK_LFE },
+    { SPK_FL, SPK_FC, SPK_FR, SPK_SL, SPK_SR, SPK_RL, SPK_RR, SPK_LFE },
+};
+
+static int find_speaker(int count, int speaker) {
+    for (int o = 0; o < count; o++) {
+        if (vorbis_layouts[count][o] == speaker) return o;
+    }
+    return -1;
+}
+
+// Adds speaker at weight to row (gains per output channel): to the same
+// speaker when the output has it, otherwise to its nearest neighbours.
+// Every output layout has either the centre (mono) or both fronts.
+static void route(float *row, int count, int speaker, float weight) {
+    int o = find_speaker(count, speaker);
+    if (o >= 0) {
+        row[o] += weight;
+        return;
+    }
+
+    int has_rear = find_speaker(count, SPK_RL) >= 0;
+    int has_side = find_speaker(count, SPK_SL) >= 0;
+    switch (speaker) {
+    case SPK_FC:
+        route(row, count, SPK_FL, weight * MINUS_3DB);
+        route(row, count, SPK_FR, weight * MINUS_3DB);
+        break;
+    case SPK_FL:
+    case SPK_FR:
+        route(row, count, SPK_FC, weight * MINUS_3DB);
+        break;
+    case SPK_SL:
+    case SPK_RL:
+        if (has_rear || has_side) route(row, count, has_rear ? SPK_RL : SPK_SL, weight);
+        else route(row, count, SPK_FL, weight * MINUS_3DB);
+        break;
+    case SPK_SR:
+    case SPK_RR:
+        if (has_rear || has_side) route(row, count, has_rear ? SPK_RR : SPK_SR, weight);
+        else route(row, count, SPK_FR, weight * MINUS_3DB);
+        break;
+    case SPK_RC:
+        route(row, count, has_rear ? SPK_RL : has_side ? SPK_SL : SPK_FL, weight * MINUS_3DB);
+        route(row, count, has_rear ? SPK_RR : has_side ? SPK_SR : SPK_FR, weight * MINUS_3DB);
+        break;
+    default:
+        break;    // LFE
+    }
+}
+
+static void build_matrix(Downmix *d, int mapping_family) {
+    int in = d->in_channels, out = d->out_channels;
+    if (mapping_family <= 1 && in <= 8 && out <= 8) {
+        for (int i = 0; i < in; i++) {
+            route(d->matrix + (size_t)i * out, out, vorbis_layouts[in][i], 1.0f);
+        }
+    } else if (mapping_family == 2) {
+        // Ambisonics: the omnidirectional W channel alone
+        for (int o = 0; o < out; o++) d->matrix[o] = 1.0f;
+    } else {
+        for (int i = 0; i < in; i++) d->matrix[(size_t)i * out + i % out] = 1.0f;
+    }
+
+    float peak = 0.0f;
+    for (int o = 0; o < out; o++) {
+        float sum = 0.0f;
+        for (int i = 0; i < in; i++) sum += fabsf(d->matrix[(size_t)i * out + o]);
+        if (sum > peak) peak = sum;
+    }
+    if (peak > 1.0f) {
+        for (size_t k = 0; k < (size_t)in * out; k++) d->matrix[k] /= peak;
+    }
+}
+
+static short to_s16(float v) {
+    if (v > 32767.0f) v = 32767.0f;
+    if (v < -32768.0f) v = -32768.0f;
+    return (short)lrintf(v);
+}
+
+static void mix_scalar(const Downmix *d, const short *in, short *out, size_t frames) {
+    const int ic = d->in_channels, oc = d->out_channels;
+    for (size_t f = 0; f < frames; f++) {
+        const short *x = in + f * ic;
+        short *y = out + f * oc;
+        for (int o = 0; o < oc; o++) {
+            float acc = 0.0f;
+            for (int i = 0; i < ic; i++) {
+                acc += x[i] * d->matrix[(size_t)i * oc + o];
+            }
+            y[o] = to_s16(acc);
+        }
+    }
+}
+
+// The vector kernels compute each output channel for several frames at
+// once (one lane per frame), then interleave while narrowing to int16
+
+#ifdef DOWNMIX_HAVE_SSE2
+static size_t mix_sse2(const Downmix *d, const short *in, short *out, size_t frames) {
+    const int ic = d->in_channels, oc = d->out_channels;
+    size_t f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        const short *x = in + f * ic;
+        __m128 y[SIMD_MAX_OUT];
+        for (int o = 0; o < oc; o++) y[o] = _mm_setzero_ps();
+        for (int i = 0; i < ic; i++) {
+            __m128 s = _mm_setr_ps(x[i], x[ic + i], x[2 * ic + i], x[3 * ic + i]);
+            const float *gain = d->matrix + (size_t)i * oc;
+            for (int o = 0; o < oc; o++) {
+                y[o] = _mm_add_ps(y[o], _mm_mul_ps(s, _mm_set1_ps(gain[o])));
+            }
+        }
+
+        short *dst = out + f * oc;
+        if (oc == 2) {
+            __m128i lo = _mm_cvtps_epi32(_mm_unpacklo_ps(y[0], y[1]));
+            __m128i hi = _mm_cvtps_epi32(_mm_unpackhi_ps(y[0], y[1]));
+            _mm_storeu_si128((__m128i*)dst, _mm_packs_epi32(lo, hi));
+        } else {
+            short lanes[SIMD_MAX_OUT][8];
+            for (int o = 0; o < oc; o++) {
+                __m128i v = _mm_cvtps_epi32(y[o]);
+                _mm_storeu_si128((__m128i*)lanes[o], _mm_packs_epi32(v, v));
+            }
+            for (int k = 0; k < 4; k++) {
+                for (int o = 0; o < oc; o++) dst[k * oc + o] = lanes[o][k];
+            }
+        }
+    }
+    return f;
+}
+#endif
+
+#ifdef DOWNMIX_HAVE_AVX2
+__attribute__((target("avx2,fma")))
+static size_t mix_avx2(const Downmix *d, const short *in, short *out, size_t frames) {
+    const int ic = d->in_channels, oc = d->out_channels;
+    const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(ic));
+    size_t f = 0;
+    // Each 32-bit gather also reads the sample after the one it wants, so
+    // the final frame is left to the scalar loop
+    for (; f + 8 < frames; f += 8) {
+        const short *x = in + f * ic;
+        __m256 y[SIMD_MAX_OUT];
+        for (int o = 0; o < oc; o++) y[o] = _mm256_setzero_ps();
+        for (int i = 0; i < ic; i++) {
+            __m256i v = _mm256_i32gather_epi32((const int*)(const void*)(x + i), index, 2);
+            __m256 s = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+            const float *gain = d->matrix + (size_t)i * oc;
+            for (int o = 0; o < oc; o++) {
+                y[o] = _mm256_fmadd_ps(s, _mm256_broadcast_ss(gain + o), y[o]);
+            }
+        }
+
+        short *dst = out + f * oc;
+        if (oc == 2) {
+            // Per 128-bit lane: frames 0-3 and 4-7, already in order after the pack
+            __m256i lo = _mm256_cvtps_epi32(_mm256_unpacklo_ps(y[0], y[1]));
+            __m256i hi = _mm256_cvtps_epi32(_mm256_unpackhi_ps(y[0], y[1]));
+            _mm256_storeu_si256((__m256i*)dst, _mm256_packs_epi32(lo, hi));
+        } else {
+            short lanes[SIMD_MAX_OUT][8];
+            for (int o = 0; o < oc; o++) {
+                __m256i v = _mm256_cvtps_epi32(y[o]);
+                __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+                _mm_storeu_si128((__m128i*)lanes[o], packed);
+            }
+            for (int k = 0; k < 8; k++) {
+                for (int o = 0; o < oc; o++) dst[k * oc + o] = lanes[o][k];
+            }
+        }
+    }
+    return f;
+}
+#endif
+
+#ifdef DOWNMIX_HAVE_NEON
+static size_t mix_neon(const Downmix *d, const short *in, short *out, size_t frames) {
+    const int ic = d->in_channels, oc = d->out_channels;
+    size_t f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        const short *x = in + f * ic;
+        float32x4_t y[SIMD_MAX_OUT];
+        for (int o = 0; o < oc; o++) y[o] = vdupq_n_f32(0.0f);
+        for (int i = 0; i < ic; i++) {
+            float column[4] = { x[i], x[ic + i], x[2 * ic + i], x[3 * ic + i] };
+            float32x4_t s = vld1q_f32(column);
+            const float *gain = d->matrix + (size_t)i * oc;
+            for (int o = 0; o < oc; o++) {
+                y[o] = vfmaq_n_f32(y[o], s, gain[o]);
+            }
+        }
+
+        short *dst = out + f * oc;
+        short lanes[SIMD_MAX_OUT][4];
+        for (int o = 0; o < oc; o++) {
+            vst1_s16(lanes[o], vqmovn_s32(vcvtnq_s32_f32(y[o])));
+        }
+        for (int k = 0; k < 4; k++) {
+            for (int o = 0; o < oc; o++) dst[k * oc + o] = lanes[o][k];
+        }
+    }
+    return f;
+}
+#endif
+
+static void select_kernel(Downmix *d) {
+    d->kernel = NULL;
+    d->kernel_name = "scalar";
+    if (d->out_channels > SIMD_MAX_OUT) {
+        return;
+    }
+#ifdef DOWNMIX_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        d->kernel = mix_avx2;
+        d->kernel_name = "avx2";
+        return;
+    }
+#endif
+#ifdef DOWNMIX_HAVE_SSE2
+    d->kernel = mix_sse2;
+    d->kernel_name = "sse2";
+#elif defined(DOWNMIX_HAVE_NEON)
+    d->kernel = mix_neon;
+    d->kernel_name = "neon";
+#endif
+}
+
+Downmix *downmix_create(int mapping_family, int in_channels, int out_channels) {
+    if (out_channels < 1 || out_channels == in_channels) {
+        return NULL;
+    }
+
+    Downmix *d = (Downmix*)calloc(1, sizeof(Downmix));
+    if (!d) return NULL;
+    d->in_channels = in_channels;
+    d->out_channels = out_channels;
+    d->matrix = (float*)calloc((size_t)in_channels * out_channels, sizeof(float));
+    if (!d->matrix) {
+        free(d);
+        return NULL;
+    }
+
+    build_matrix(d, mapping_family);
+    select_kernel(d);
+    return d;
+}
+
+void downmix_free(Downmix *d) {
+    if (!d) return;
+    free(d->matrix);
+    free(d);
+}
+
+void downmix_process(const Downmix *d, const short *in, short *out, size_t frames) {
+    size_t done = d->kernel ? d->kernel(d, in, out, frames) : 0;
+    mix_scalar(d, in + done * d->in_channels, out + done * d->out_channels, frames - done);
+}
+
+const char *downmix_kernel(const Downmix *d) {
+    return d->kernel_name;
+}
+
+void downmix_use_scalar(Downmix *d) {
+    d->kernel = NULL;
+    d->kernel_name = "scalar";
+}
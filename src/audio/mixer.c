@@ -0,0 +1,359 @@
+#include "mixer.h"
+#include "audio_callback.h"
+#include "audio_backend.h"
+#include "pcm_convert.h"
+#include "timer.h"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIXER_HAVE_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MIXER_HAVE_AVX2 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MIXER_HAVE_NEON 1
+#endif
+
+#define MIXER_BLOCK_FRAMES 1024   // frames summed per step of a callback
+#define MIXER_CALLBACK_TIMEOUT 1.0  // seconds a stopped stream gets to finish its callback
+
+typedef void (*AccumulateKernel)(float *acc, const short *in, size_t n, float gain);
+
+struct MixerSource {
+    Mixer *mixer;
+    _Atomic(AudioData*) audio_data;  // bound output's ring, NULL when none
+    atomic_int playing;              // pulled by the callback
+    atomic_uint gain_bits;           // linear gain, as float bits
+    atomic_int cancelled;
+    atomic_ullong frames;            // mixed so far
+};
+
+struct Mixer {
+    PaStream *stream;
+    int sample_rate;
+    int channels;
+    atomic_int running;
+    _Atomic(MixerSource*) slots[MIXER_MAX_SOURCES];
+    atomic_ullong callback_seq;      // bumped on callback entry and exit: odd while inside
+    AccumulateKernel accumulate;
+    float *mix;                      // MIXER_BLOCK_FRAMES of the running sum
+    short *scratch;                  // one source's MIXER_BLOCK_FRAMES
+};
+
+static void accumulate_scalar(float *acc, const short *in, size_t n, float gain) {
+    for (size_t i = 0; i < n; i++) {
+        acc[i] += in[i] * gain;
+    }
+}
+
+#ifdef MIXER_HAVE_SSE2
+static void accumulate_sse2(float *acc, const short *in, size_t n, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(lo, g)));
+        _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(hi, g)));
+    }
+    accumulate_scalar(acc + i, in + i, n - i, gain);
+}
+#endif
+
+#ifdef MIXER_HAVE_AVX2
+__attribute__((target("avx2,fma")))
+static void accumulate_avx2(float *acc, const short *in, size_t n, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(lo, g, _mm256_loadu_ps(acc + i)));
+        _mm256_storeu_ps(acc + i + 8, _mm256_fmadd_ps(hi, g, _mm256_loadu_ps(acc + i + 8)));
+    }
+    accumulate_scalar(acc + i, in + i, n - i, gain);
+}
+#endif
+
+#ifdef MIXER_HAVE_NEON
+static void accumulate_neon(float *acc, const short *in, size_t n, float gain) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+        vst1q_f32(acc + i, vfmaq_n_f32(vld1q_f32(acc + i), lo, gain));
+        vst1q_f32(acc + i + 4, vfmaq_n_f32(vld1q_f32(acc + i + 4), hi, gain));
+    }
+    accumulate_scalar(acc + i, in + i, n - i, gain);
+}
+#endif
+
+static AccumulateKernel select_kernel(const char **name) {
+#ifdef MIXER_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "avx2";
+        return accumulate_avx2;
+    }
+#endif
+#ifdef MIXER_HAVE_SSE2
+    *name = "sse2";
+    return accumulate_sse2;
+#elif defined(MIXER_HAVE_NEON)
+    *name = "neon";
+    return accumulate_neon;
+#else
+    *name = "scalar";
+    return accumulate_scalar;
+#endif
+}
+
+const char *mixer_kernel(void) {
+    const char *name;
+    select_kernel(&name);
+    return name;
+}
+
+static float load_gain(const MixerSource *source) {
+    unsigned int bits = atomic_load_explicit(&source->gain_bits, memory_order_relaxed);
+    float gain;
+    memcpy(&gain, &bits, sizeof(gain));
+    return gain;
+}
+
+// Sums every playing source's ring into one buffer. Each source is read
+// through audio_callback(), exactly as if it had the stream to itself; the
+// sum is clipped to int16 once, at the end.
+static int mixer_callback(const void *input, void *output, unsigned long frameCount,
+                          const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags,
+                          void *userData) {
+    Mixer *mixer = (Mixer*)userData;
+    short *out = (short*)output;
+    (void)input;
+    atomic_fetch_add(&mixer->callback_seq, 1);
+
+    for (unsigned long done = 0; done < frameCount; ) {
+        unsigned long n = frameCount - done;
+        if (n > MIXER_BLOCK_FRAMES) n = MIXER_BLOCK_FRAMES;
+        size_t samples = (size_t)n * mixer->channels;
+        memset(mixer->mix, 0, samples * sizeof(float));
+
+        for (int i = 0; i < MIXER_MAX_SOURCES && !stop_playback; i++) {
+            MixerSource *source = atomic_load(&mixer->slots[i]);
+            if (!source || !atomic_load(&source->playing)) continue;
+            AudioData *data = atomic_load(&source->audio_data);
+            if (!data) continue;
+
+            if (atomic_load(&source->cancelled)) {
+                // Its producer may be waiting for room that will not come
+                atomic_store(&source->playing, 0);
+                wakeup_signal(&data->wakeup);
+                continue;
+            }
+
+            // A drained source returns paComplete with its tail padded by
+            // silence. Stopping (Ctrl+C) returns it without writing at all,
+            // so the scratch still holds the previous source.
+            if (audio_callback(NULL, mixer->scratch, n, timeInfo, statusFlags, data) != paContinue) {
+                atomic_store(&source->playing, 0);
+                if (!data->playback_finished) continue;
+            }
+            mixer->accumulate(mixer->mix, mixer->scratch, samples, load_gain(source));
+            atomic_fetch_add_explicit(&source->frames, n, memory_order_relaxed);
+        }
+
+        pcm_float_to_s16(mixer->mix, out + (size_t)done * mixer->channels, samples, 1.0f / 32768.0f, NULL);
+        done += n;
+    }
+
+    atomic_fetch_add(&mixer->callback_seq, 1);
+    return paContinue;
+}
+
+// Returns once any callback that might have seen the old slot or ring
+// state has finished. Callers change that state first, so a callback
+// entering after the sequence is read already sees the new state; only
+// one inside it at that moment is waited for, however long it takes. A
+// stream that stopped or failed gets MIXER_CALLBACK_TIMEOUT to leave it.
+static void wait_for_callback(Mixer *mixer) {
+    unsigned long long seq = atomic_load(&mixer->callback_seq);
+    if ((seq & 1) == 0) return;
+
+    double deadline = 0;
+    while (atomic_load(&mixer->callback_seq) == seq) {
+        if (Pa_IsStreamActive(mixer->stream) != 1) {
+            if (deadline == 0) {
+                deadline = timer_now() + MIXER_CALLBACK_TIMEOUT;
+            } else if (timer_now() > deadline) {
+                return;
+            }
+        }
+        Pa_Sleep(1);
+    }
+}
+
+Mixer *mixer_create(int sample_rate, int channels, int frames_per_buffer, double latency_ms) {
+    if (!audio_backend_acquire()) {
+        return NULL;
+    }
+
+    Mixer *mixer = (Mixer*)calloc(1, sizeof(Mixer));
+    if (!mixer) {
+        audio_backend_release();
+        return NULL;
+    }
+    mixer->sample_rate = sample_rate;
+    mixer->channels = channels;
+    const char *name;
+    mixer->accumulate = select_kernel(&name);
+    mixer->mix = (float*)malloc((size_t)MIXER_BLOCK_FRAMES * channels * sizeof(float));
+    mixer->scratch = (short*)malloc((size_t)MIXER_BLOCK_FRAMES * channels * sizeof(short));
+    if (!mixer->mix || !mixer->scratch) {
+        fprintf(stderr, "Error: Failed to allocate mixer buffers\n");
+        mixer_destroy(mixer);
+        return NULL;
+    }
+
+    PaStreamParameters outputParameters;
+    outputParameters.device = Pa_GetDefaultOutputDevice();
+    if (outputParameters.device == paNoDevice) {
+        fprintf(stderr, "Error: No default output device.\n");
+        mixer_destroy(mixer);
+        return NULL;
+    }
+    const PaDeviceInfo *device = Pa_GetDeviceInfo(outputParameters.device);
+    outputParameters.channelCount = channels;
+    outputParameters.sampleFormat = paInt16;
+    outputParameters.suggestedLatency = (latency_ms > 0) ? latency_ms / 1000.0 : device->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    unsigned long buffer_frames = DEFAULT_FRAMES_PER_BUFFER;
+    if (frames_per_buffer > 0) {
+        buffer_frames = (unsigned long)frames_per_buffer;
+    } else if (frames_per_buffer < 0) {
+        buffer_frames = paFramesPerBufferUnspecified;
+    }
+
+    PaError err = Pa_OpenStream(&mixer->stream, NULL, &outputParameters, sample_rate,
+                                buffer_frames, paClipOff, mixer_callback, mixer);
+    if (err == paNoError) {
+        err = Pa_StartStream(mixer->stream);
+        if (err != paNoError) {
+            Pa_CloseStream(mixer->stream);
+            mixer->stream = NULL;
+        }
+    }
+    if (err != paNoError) {
+        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
+        mixer->stream = NULL;
+        mixer_destroy(mixer);
+        return NULL;
+    }
+    atomic_store(&mixer->running, 1);
+
+    printf("Using audio device: %s (%d Hz, %d channels)\n", device->name, sample_rate, channels);
+    return mixer;
+}
+
+void mixer_destroy(Mixer *mixer) {
+    if (!mixer) return;
+    if (mixer->stream) {
+        Pa_StopStream(mixer->stream);
+        Pa_CloseStream(mixer->stream);
+    }
+    atomic_store(&mixer->running, 0);
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        free(atomic_load(&mixer->slots[i]));
+    }
+    free(mixer->mix);
+    free(mixer->scratch);
+    free(mixer);
+    audio_backend_release();
+}
+
+int mixer_sample_rate(const Mixer *mixer) {
+    return mixer->sample_rate;
+}
+
+int mixer_channels(const Mixer *mixer) {
+    return mixer->channels;
+}
+
+MixerSource *mixer_add(Mixer *mixer, double gain_db) {
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        if (atomic_load(&mixer->slots[i])) continue;
+
+        MixerSource *source = (MixerSource*)calloc(1, sizeof(MixerSource));
+        if (!source) return NULL;
+        source->mixer = mixer;
+        atomic_init(&source->audio_data, NULL);
+        atomic_init(&source->playing, 0);
+        atomic_init(&source->cancelled, 0);
+        atomic_init(&source->frames, 0);
+        mixer_source_set_gain(source, gain_db);
+        atomic_store(&mixer->slots[i], source);
+        return source;
+    }
+    return NULL;
+}
+
+void mixer_remove(Mixer *mixer, MixerSource *source) {
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        if (atomic_load(&mixer->slots[i]) == source) {
+            atomic_store(&mixer->slots[i], NULL);
+            wait_for_callback(mixer);
+            free(source);
+            return;
+        }
+    }
+}
+
+void mixer_source_bind(MixerSource *source, AudioData *audio_data) {
+    atomic_store(&source->playing, 0);
+    atomic_store(&source->audio_data, audio_data);
+}
+
+void mixer_source_unbind(MixerSource *source) {
+    atomic_store(&source->playing, 0);
+    atomic_store(&source->audio_data, NULL);
+    wait_for_callback(source->mixer);
+}
+
+void mixer_source_start(MixerSource *source) {
+    atomic_store(&source->playing, 1);
+}
+
+double mixer_source_time(const MixerSource *source) {
+    return Pa_GetStreamTime(source->mixer->stream);
+}
+
+void mixer_source_set_gain(MixerSource *source, double gain_db) {
+    float gain = powf(10.0f, (float)gain_db / 20.0f);
+    unsigned int bits;
+    memcpy(&bits, &gain, sizeof(bits));
+    atomic_store_explicit(&source->gain_bits, bits, memory_order_relaxed);
+}
+
+double mixer_source_gain(const MixerSource *source) {
+    return 20.0 * log10(load_gain(source));
+}
+
+double mixer_source_seconds(const MixerSource *source) {
+    return (double)atomic_load_explicit(&source->frames, memory_order_relaxed) / source->mixer->sample_rate;
+}
+
+void mixer_source_cancel(MixerSource *source) {
+    atomic_store(&source->cancelled, 1);
+}
+
+int mixer_source_cancelled(const MixerSource *source) {
+    return atomic_load(&source->cancelled);
+}
@@ -0,0 +1,179 @@
+#include "pcm_convert.h"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCM_HAVE_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PCM_HAVE_AVX2 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PCM_HAVE_NEON 1
+#endif
+
+#define PCM_SCALE 32768.0f
+#define PCM_MIN -32768.0f
+#define PCM_MAX 32767.0f
+
+void pcm_dither_init(PcmDither *dither, unsigned int seed) {
+    unsigned int state = seed ? seed : 0x9E3779B9u;
+    for (int i = 0; i < PCM_DITHER_TABLE_SIZE; i++) {
+        float r[2];
+        for (int j = 0; j < 2; j++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            r[j] = (float)(state >> 8) / 16777216.0f;
+        }
+        // Sum of two uniforms: triangular over (-1, 1) LSB
+        dither->noise[i] = r[0] + r[1] - 1.0f;
+    }
+    dither->pos = 0;
+}
+
+// NaN clamps to PCM_MIN, matching the max-then-min order of the SIMD kernels
+static void convert_scalar(const float *in, short *out, size_t n, float scale, const float *noise) {
+    float k = scale * PCM_SCALE;
+    for (size_t i = 0; i < n; i++) {
+        float v = in[i] * k;
+        if (noise) v += noise[i];
+        if (!(v >= PCM_MIN)) v = PCM_MIN;
+        if (v > PCM_MAX) v = PCM_MAX;
+        out[i] = (short)lrintf(v);
+    }
+}
+
+#ifdef PCM_HAVE_SSE2
+static void convert_sse2(const float *in, short *out, size_t n, float scale, const float *noise) {
+    const __m128 k = _mm_set1_ps(scale * PCM_SCALE);
+    const __m128 lo = _mm_set1_ps(PCM_MIN);
+    const __m128 hi = _mm_set1_ps(PCM_MAX);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), k);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), k);
+        if (noise) {
+            a = _mm_add_ps(a, _mm_loadu_ps(noise + i));
+            b = _mm_add_ps(b, _mm_loadu_ps(noise + i + 4));
+        }
+        a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+        b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i*)(out + i), packed);
+    }
+
+    convert_scalar(in + i, out + i, n - i, scale, noise ? noise + i : NULL);
+}
+#endif
+
+#ifdef PCM_HAVE_AVX2
+__attribute__((target("avx2")))
+static void convert_avx2(const float *in, short *out, size_t n, float scale, const float *noise) {
+    const __m256 k = _mm256_set1_ps(scale * PCM_SCALE);
+    const __m256 lo = _mm256_set1_ps(PCM_MIN);
+    const __m256 hi = _mm256_set1_ps(PCM_MAX);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), k);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), k);
+        if (noise) {
+            a = _mm256_add_ps(a, _mm256_loadu_ps(noise + i));
+            b = _mm256_add_ps(b, _mm256_loadu_ps(noise + i + 8));
+        }
+        a = _mm256_min_ps(_mm256_max_ps(a, lo), hi);
+        b = _mm256_min_ps(_mm256_max_ps(b, lo), hi);
+        // packs works per 128-bit lane; restore sample order afterwards
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+
+    convert_scalar(in + i, out + i, n - i, scale, noise ? noise + i : NULL);
+}
+#endif
+
+#ifdef PCM_HAVE_NEON
+static void convert_neon(const float *in, short *out, size_t n, float scale, const float *noise) {
+    const float32x4_t k = vdupq_n_f32(scale * PCM_SCALE);
+    const float32x4_t lo = vdupq_n_f32(PCM_MIN);
+    const float32x4_t hi = vdupq_n_f32(PCM_MAX);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t a = vmulq_f32(vld1q_f32(in + i), k);
+        float32x4_t b = vmulq_f32(vld1q_f32(in + i + 4), k);
+        if (noise) {
+            a = vaddq_f32(a, vld1q_f32(noise + i));
+            b = vaddq_f32(b, vld1q_f32(noise + i + 4));
+        }
+        a = vminq_f32(vmaxnmq_f32(a, lo), hi);
+        b = vminq_f32(vmaxnmq_f32(b, lo), hi);
+        int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b)));
+        vst1q_s16(out + i, packed);
+    }
+
+    convert_scalar(in + i, out + i, n - i, scale, noise ? noise + i : NULL);
+}
+#endif
+
+typedef void (*ConvertKernel)(const float *, short *, size_t, float, const float *);
+
+static ConvertKernel select_kernel(const char **name) {
+#ifdef PCM_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return convert_avx2;
+    }
+#endif
+#ifdef PCM_HAVE_SSE2
+    *name = "sse2";
+    return convert_sse2;
+#elif defined(PCM_HAVE_NEON)
+    *name = "neon";
+    return convert_neon;
+#else
+    *name = "scalar";
+    return convert_scalar;
+#endif
+}
+
+// Feeds the kernel in runs that do not cross the end of the noise table
+static void convert_with(ConvertKernel kernel, const float *in, short *out, size_t n,
+                         float scale, PcmDither *dither) {
+    if (!dither) {
+        kernel(in, out, n, scale, NULL);
+        return;
+    }
+
+    while (n > 0) {
+        size_t run = PCM_DITHER_TABLE_SIZE - dither->pos;
+        if (run > n) run = n;
+        kernel(in, out, run, scale, dither->noise + dither->pos);
+        dither->pos = (dither->pos + run) & (PCM_DITHER_TABLE_SIZE - 1);
+        in += run;
+        out += run;
+        n -= run;
+    }
+}
+
+void pcm_float_to_s16(const float *in, short *out, size_t n, float scale, PcmDither *dither) {
+    const char *name;
+    convert_with(select_kernel(&name), in, out, n, scale, dither);
+}
+
+void pcm_float_to_s16_scalar(const float *in, short *out, size_t n, float scale, PcmDither *dither) {
+    convert_with(convert_scalar, in, out, n, scale, dither);
+}
+
+const char *pcm_convert_kernel(void) {
+    const char *name;
+    select_kernel(&name);
+    return name;
+}
@@ -0,0 +1,78 @@
+#include "playback_stats.h"
+
+void stats_init(PlaybackStats *stats) {
+    atomic_ullong *counters[] = {
+        &stats->callbacks, &stats->underflows, &stats->overflows,
+        &stats->silence_fills, &stats->silence_frames, &stats->dropped_samples
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        atomic_init(counters[i], 0);
+    }
+    atomic_init(&stats->fill_low_frames, -1);
+
+    StatsHistogram *histograms[] = { &stats->callback_time, &stats->decode_time };
+    for (int h = 0; h < 2; h++) {
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            atomic_init(&histograms[h]->buckets[i], 0);
+        }
+        atomic_init(&histograms[h]->count, 0);
+        atomic_init(&histograms[h]->total_us, 0);
+        atomic_init(&histograms[h]->max_us, 0);
+    }
+}
+
+// Only one thread writes each counter, so a relaxed load/store pair is a
+// complete increment and avoids a locked read-modify-write
+void stats_add(atomic_ullong *counter, unsigned long long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+void stats_histogram_add(StatsHistogram *histogram, double seconds) {
+    unsigned int us = (seconds > 0) ? (unsigned int)(seconds * 1e6) : 0;
+
+    int bucket = 0;
+    for (unsigned int v = us; v > 1 && bucket < STATS_HISTOGRAM_BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+
+    atomic_store_explicit(&histogram->buckets[bucket],
+                          atomic_load_explicit(&histogram->buckets[bucket], memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    stats_add(&histogram->count, 1);
+    stats_add(&histogram->total_us, us);
+    if (us > atomic_load_explicit(&histogram->max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&histogram->max_us, us, memory_order_relaxed);
+    }
+}
+
+unsigned int stats_histogram_percentile(StatsHistogram *histogram, double p) {
+    unsigned long long count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    if (count == 0) return 0;
+
+    unsigned int max = atomic_load_explicit(&histogram->max_us, memory_order_relaxed);
+    unsigned long long rank = (unsigned long long)(p * (double)count);
+    unsigned long long seen = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (seen > rank) {
+            unsigned int bound = 2u << i;
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+void stats_histogram_json(FILE *f, StatsHistogram *histogram) {
+    unsigned long long count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    unsigned long long total = atomic_load_explicit(&histogram->total_us, memory_order_relaxed);
+
+    fprintf(f, "{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u,\"log2_us\":[",
+            count, count ? (double)total / count : 0.0,
+            stats_histogram_percentile(histogram, 0.5), stats_histogram_percentile(histogram, 0.99),
+            atomic_load_explicit(&histogram->max_us, memory_order_relaxed));
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        fprintf(f, "%s%u", i ? "," : "", atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed));
+    }
+    fprintf(f, "]}");
+}
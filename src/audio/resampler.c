@@ -0,0 +1,332 @@
+#include "resampler.h"
+#include "pcm_convert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLER_HAVE_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RESAMPLER_HAVE_AVX2 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RESAMPLER_HAVE_NEON 1
+#endif
+
+#define BASE_TAPS 64          // per phase when not downsampling
+#define MAX_PHASES 1024
+#define MAX_DECIMATION 8      // down / up
+#define CUTOFF 0.92           // passband edge, fraction of the lower Nyquist rate
+#define KAISER_BETA 8.0       // about 80 dB stopband
+#define BLOCK_FRAMES 1024     // input frames buffered per step
+
+typedef float (*DotKernel)(const float *h, const float *x, int taps);
+
+struct Resampler {
+    int channels;
+    int up, down;
+    int taps;                 // multiple of 8
+    float *filter;            // up rows of taps; row p is the offset p / up
+    DotKernel dot;
+
+    // Planar input history, in int16 units: the first taps/2 - 1 frames
+    // of a fresh stream are zeros so the first output lands on input 0
+    float *history;
+    size_t capacity;          // frames per channel
+    size_t frames;
+    size_t pos;               // first tap of the next output
+    int phase;
+
+    unsigned long long in_total;
+    unsigned long long out_total;
+    float *out;               // interleaved float output of one step
+};
+
+static float dot_scalar(const float *h, const float *x, int taps) {
+    float sum[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < taps; i += 4) {
+        sum[0] += h[i] * x[i];
+        sum[1] += h[i + 1] * x[i + 1];
+        sum[2] += h[i + 2] * x[i + 2];
+        sum[3] += h[i + 3] * x[i + 3];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef RESAMPLER_HAVE_SSE2
+static float dot_sse2(const float *h, const float *x, int taps) {
+    __m128 a = _mm_setzero_ps();
+    __m128 b = _mm_setzero_ps();
+    for (int i = 0; i < taps; i += 8) {
+        a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(h + i), _mm_loadu_ps(x + i)));
+        b = _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(h + i + 4), _mm_loadu_ps(x + i + 4)));
+    }
+    a = _mm_add_ps(a, b);
+    a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+    return _mm_cvtss_f32(a);
+}
+#endif
+
+#ifdef RESAMPLER_HAVE_AVX2
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float *h, const float *x, int taps) {
+    __m256 a = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= taps; i += 16) {
+        a = _mm256_fmadd_ps(_mm256_loadu_ps(h + i), _mm256_loadu_ps(x + i), a);
+        a = _mm256_fmadd_ps(_mm256_loadu_ps(h + i + 8), _mm256_loadu_ps(x + i + 8), a);
+    }
+    if (i < taps) {
+        a = _mm256_fmadd_ps(_mm256_loadu_ps(h + i), _mm256_loadu_ps(x + i), a);
+    }
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#endif
+
+#ifdef RESAMPLER_HAVE_NEON
+static float dot_neon(const float *h, const float *x, int taps) {
+    float32x4_t a = vdupq_n_f32(0.0f);
+    float32x4_t b = vdupq_n_f32(0.0f);
+    for (int i = 0; i < taps; i += 8) {
+        a = vfmaq_f32(a, vld1q_f32(h + i), vld1q_f32(x + i));
+        b = vfmaq_f32(b, vld1q_f32(h + i + 4), vld1q_f32(x + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(a, b));
+}
+#endif
+
+static DotKernel select_kernel(const char **name) {
+#ifdef RESAMPLER_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "avx2";
+        return dot_avx2;
+    }
+#endif
+#ifdef RESAMPLER_HAVE_SSE2
+    *name = "sse2";
+    return dot_sse2;
+#elif defined(RESAMPLER_HAVE_NEON)
+    *name = "neon";
+    return dot_neon;
+#else
+    *name = "scalar";
+    return dot_scalar;
+#endif
+}
+
+const char *resampler_kernel(void) {
+    const char *name;
+    select_kernel(&name);
+    return name;
+}
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function, for the Kaiser window
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc, one row per phase, each normalised to unity gain
+static void design_filter(Resampler *r) {
+    double ratio = (r->up < r->down) ? (double)r->up / r->down : 1.0;
+    double fc = 0.5 * ratio * CUTOFF;   // cycles per input sample
+    double half = r->taps / 2.0;
+    double norm = bessel_i0(KAISER_BETA);
+
+    for (int p = 0; p < r->up; p++) {
+        float *row = r->filter + (size_t)p * r->taps;
+        double sum = 0.0;
+        for (int j = 0; j < r->taps; j++) {
+            double t = j - (r->taps / 2 - 1) - (double)p / r->up;
+            double x = 2.0 * fc * t;
+            double sinc = (fabs(x) < 1e-12) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double w = t / half;
+            double window = (fabs(w) >= 1.0) ? 0.0 : bessel_i0(KAISER_BETA * sqrt(1.0 - w * w)) / norm;
+            double h = 2.0 * fc * sinc * window;
+            row[j] = (float)h;
+            sum += h;
+        }
+        for (int j = 0; j < r->taps; j++) {
+            row[j] = (float)(row[j] / sum);
+        }
+    }
+}
+
+Resampler *resampler_create(int in_rate, int out_rate, int channels) {
+    if (in_rate <= 0 || out_rate <= 0 || channels < 1) {
+        return NULL;
+    }
+    int g = gcd(in_rate, out_rate);
+    int up = out_rate / g, down = in_rate / g;
+    if (up > MAX_PHASES || down > up * MAX_DECIMATION) {
+        return NULL;
+    }
+
+    Resampler *r = (Resampler*)calloc(1, sizeof(Resampler));
+    if (!r) return NULL;
+    r->channels = channels;
+    r->up = up;
+    r->down = down;
+
+    // Downsampling narrows the passband, so the filter spans more input
+    int taps = BASE_TAPS;
+    if (down > up) taps = (int)ceil((double)BASE_TAPS * down / up);
+    r->taps = (taps + 7) & ~7;
+
+    const char *name;
+    r->dot = select_kernel(&name);
+
+    r->capacity = (size_t)r->taps + BLOCK_FRAMES;
+    r->filter = (float*)malloc((size_t)up * r->taps * sizeof(float));
+    r->history = (float*)malloc(r->capacity * channels * sizeof(float));
+    r->out = (float*)malloc(resampler_max_output(r, BLOCK_FRAMES) * channels * sizeof(float));
+    if (!r->filter || !r->history || !r->out) {
+        resampler_free(r);
+        return NULL;
+    }
+
+    design_filter(r);
+    resampler_reset(r);
+    return r;
+}
+
+void resampler_free(Resampler *r) {
+    if (!r) return;
+    free(r->filter);
+    free(r->history);
+    free(r->out);
+    free(r);
+}
+
+void resampler_reset(Resampler *r) {
+    r->frames = (size_t)r->taps / 2 - 1;
+    for (int c = 0; c < r->channels; c++) {
+        memset(r->history + (size_t)c * r->capacity, 0, r->frames * sizeof(float));
+    }
+    r->pos = 0;
+    r->phase = 0;
+    r->in_total = 0;
+    r->out_total = 0;
+}
+
+int resampler_taps(const Resampler *r) {
+    return r->taps;
+}
+
+void resampler_use_scalar(Resampler *r) {
+    r->dot = dot_scalar;
+}
+
+size_t resampler_max_output(const Resampler *r, size_t in_frames) {
+    // Everything buffered plus the zeros a drain appends
+    size_t pending = r->frames - r->pos + in_frames + (size_t)r->taps;
+    return (size_t)((unsigned long long)pending * r->up / r->down) + 1;
+}
+
+// Appends up to n interleaved frames (NULL: zeros) to the planar history;
+// returns how many fitted
+static size_t append(Resampler *r, const short *in, size_t n) {
+    // Drop what no future output can reach
+    if (r->pos > 0) {
+        for (int c = 0; c < r->channels; c++) {
+            float *x = r->history + (size_t)c * r->capacity;
+            memmove(x, x + r->pos, (r->frames - r->pos) * sizeof(float));
+        }
+        r->frames -= r->pos;
+        r->pos = 0;
+    }
+
+    size_t room = r->capacity - r->frames;
+    if (n > room) n = room;
+    for (int c = 0; c < r->channels; c++) {
+        float *x = r->history + (size_t)c * r->capacity + r->frames;
+        if (!in) {
+            memset(x, 0, n * sizeof(float));
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            x[i] = in[i * r->channels + c];
+        }
+    }
+    r->frames += n;
+    return n;
+}
+
+// Produces up to limit frames from the buffered history into r->out
+static size_t run(Resampler *r, unsigned long long limit) {
+    size_t produced = 0;
+    while (r->pos + (size_t)r->taps <= r->frames && produced < limit) {
+        const float *h = r->filter + (size_t)r->phase * r->taps;
+        float *o = r->out + produced * r->channels;
+        for (int c = 0; c < r->channels; c++) {
+            o[c] = r->dot(h, r->history + (size_t)c * r->capacity + r->pos, r->taps);
+        }
+        produced++;
+
+        r->phase += r->down;
+        r->pos += (size_t)(r->phase / r->up);
+        r->phase %= r->up;
+    }
+    return produced;
+}
+
+// Narrows r->out to int16 with the shared SIMD converter
+static void emit(Resampler *r, size_t produced, short *out) {
+    pcm_float_to_s16(r->out, out, produced * r->channels, 1.0f / 32768.0f, NULL);
+    r->out_total += produced;
+}
+
+size_t resampler_process(Resampler *r, const short *in, size_t in_frames, short *out) {
+    size_t written = 0;
+    while (in_frames > 0) {
+        size_t n = append(r, in, in_frames < BLOCK_FRAMES ? in_frames : BLOCK_FRAMES);
+        in += n * r->channels;
+        in_frames -= n;
+        r->in_total += n;
+
+        size_t produced = run(r, ~0ULL);
+        emit(r, produced, out + written * r->channels);
+        written += produced;
+    }
+    return written;
+}
+
+size_t resampler_drain(Resampler *r, short *out) {
+    // One output per up/down input frames, counting from input 0
+    unsigned long long total = (r->in_total * r->up + r->down - 1) / r->down;
+    size_t written = 0;
+    size_t zeros = (size_t)r->taps;
+    while (r->out_total < total) {
+        size_t n = append(r, NULL, zeros);
+        zeros -= n;
+        size_t produced = run(r, total - r->out_total);
+        if (produced == 0 && n == 0) break;
+        emit(r, produced, out + written * r->channels);
+        written += produced;
+    }
+    return written;
+}
@@ -0,0 +1,281 @@
+#include "sim_device.h"
+#include "audio_callback.h"
+#include "timer.h"
+
+#define SIM_DEFAULT_DECODE_MS 0.2
+#define SIM_DEFAULT_SEED 1
+
+struct SimDevice {
+    SimConfig config;
+    AudioData *audio_data;
+    int sample_rate;
+    int channels;
+    unsigned long frames_per_buffer;
+    double period;        // seconds per callback buffer
+    double latency;       // a buffer is due this long before its DAC time
+    short *buffer;        // what the callback writes; never played
+
+    double now;           // virtual time the producer has reached
+    double next_nominal;  // when the next callback is scheduled
+    double next_fire;     // when it actually runs (nominal plus jitter)
+    int running;
+    unsigned int rng;
+
+    double decoded;       // seconds of audio decoded, for stall spacing
+    double next_stall;
+
+    FILE *trace;
+    unsigned long long silence_seen;
+    unsigned long long late_callbacks;
+    unsigned long long stalls;
+    double worst_late;
+    double real_start;
+};
+
+// xorshift32: the same sequence for the same seed on every platform
+static double sim_random(SimDevice *sim) {
+    unsigned int x = sim->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rng = x;
+    return (double)x / 4294967296.0;
+}
+
+static int parse_number(const char *key, const char *value, double *out) {
+    char *end;
+    double number = strtod(value, &end);
+    if (end == value || *end != '\0' || number < 0) {
+        fprintf(stderr, "Error: Bad value '%s' for simulate %s\n", value, key);
+        return 0;
+    }
+    *out = number;
+    return 1;
+}
+
+static int parse_option(SimConfig *config, const char *key, const char *value) {
+    if (strcmp(key, "decode") == 0) {
+        return parse_number(key, value, &config->decode_ms);
+    } else if (strcmp(key, "decode-jitter") == 0) {
+        return parse_number(key, value, &config->decode_jitter_ms);
+    } else if (strcmp(key, "jitter") == 0) {
+        return parse_number(key, value, &config->jitter_ms);
+    } else if (strcmp(key, "seed") == 0) {
+        double seed;
+        if (!parse_number(key, value, &seed)) return 0;
+        config->seed = (unsigned int)seed;
+        return 1;
+    } else if (strcmp(key, "stall") == 0) {
+        char ms[64];
+        const char *slash = strchr(value, '/');
+        size_t length = slash ? (size_t)(slash - value) : 0;
+        if (!slash || length >= sizeof(ms)) {
+            fprintf(stderr, "Error: simulate stall takes <ms>/<seconds>\n");
+            return 0;
+        }
+        memcpy(ms, value, length);
+        ms[length] = '\0';
+        return parse_number(key, ms, &config->stall_ms) && parse_number(key, slash + 1, &config->stall_every);
+    } else if (strcmp(key, "trace") == 0) {
+        if (!*value || strlen(value) >= sizeof(config->trace_path)) {
+            fprintf(stderr, "Error: Bad simulate trace path\n");
+            return 0;
+        }
+        strcpy(config->trace_path, value);
+        return 1;
+    }
+    fprintf(stderr, "Error: Unknown simulate option '%s'\n", key);
+    return 0;
+}
+
+int sim_config_parse(SimConfig *config, const char *spec) {
+    memset(config, 0, sizeof(*config));
+    config->decode_ms = SIM_DEFAULT_DECODE_MS;
+    config->seed = SIM_DEFAULT_SEED;
+
+    char item[SIM_PATH_MAX + 64];
+    while (*spec) {
+        const char *comma = strchr(spec, ',');
+        size_t length = comma ? (size_t)(comma - spec) : strlen(spec);
+        if (length >= sizeof(item)) {
+            fprintf(stderr, "Error: Simulate option too long\n");
+            return 0;
+        }
+        memcpy(item, spec, length);
+        item[length] = '\0';
+        spec += comma ? length + 1 : length;
+        if (length == 0) continue;
+
+        char *equals = strchr(item, '=');
+        if (!equals) {
+            fprintf(stderr, "Error: Simulate option '%s' needs a value\n", item);
+            return 0;
+        }
+        *equals = '\0';
+        if (!parse_option(config, item, equals + 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+SimDevice *sim_device_create(const SimConfig *config, AudioData *audio_data, int sample_rate, int channels,
+                             unsigned long frames_per_buffer, double latency) {
+    SimDevice *sim = (SimDevice*)calloc(1, sizeof(SimDevice));
+    if (!sim) {
+        fprintf(stderr, "Error: Failed to allocate simulated device\n");
+        return NULL;
+    }
+    sim->config = *config;
+    sim->audio_data = audio_data;
+    sim->sample_rate = sample_rate;
+    sim->channels = channels;
+    sim->frames_per_buffer = frames_per_buffer;
+    sim->period = (double)frames_per_buffer / sample_rate;
+    sim->latency = latency;
+    sim->rng = config->seed ? config->seed : SIM_DEFAULT_SEED;
+    sim->next_stall = config->stall_every;
+    sim->real_start = timer_now();
+
+    sim->buffer = (short*)malloc(frames_per_buffer * channels * sizeof(short));
+    if (!sim->buffer) {
+        fprintf(stderr, "Error: Failed to allocate simulated device\n");
+        free(sim);
+        return NULL;
+    }
+    if (config->trace_path[0]) {
+        sim->trace = fopen(config->trace_path, "w");
+        if (!sim->trace) {
+            fprintf(stderr, "Error: Cannot create trace file '%s'\n", config->trace_path);
+            free(sim->buffer);
+            free(sim);
+            return NULL;
+        }
+        fprintf(sim->trace, "time_s,fill_ms,silence_ms,late_ms\n");
+    }
+    return sim;
+}
+
+void sim_device_free(SimDevice *sim) {
+    if (!sim) return;
+    if (sim->trace) fclose(sim->trace);
+    free(sim->buffer);
+    free(sim);
+}
+
+double sim_device_time(const SimDevice *sim) {
+    return sim->now;
+}
+
+// Jitter only ever delays a callback, and never past its successor
+static void schedule(SimDevice *sim) {
+    double fire = sim->next_nominal + sim->config.jitter_ms / 1000.0 * sim_random(sim);
+    sim->next_fire = (fire > sim->next_fire) ? fire : sim->next_fire;
+}
+
+void sim_device_start(SimDevice *sim) {
+    sim->running = 1;
+    sim->next_nominal = sim->now;
+    sim->next_fire = sim->now;
+    schedule(sim);
+}
+
+// One callback at its fire time. One that runs after its buffer was due
+// at the DAC is reported as an output underflow, as a late host would.
+static void run_callback(SimDevice *sim) {
+    AudioData *data = sim->audio_data;
+    double deadline = sim->next_nominal + sim->latency;
+    double late = sim->next_fire - deadline;
+
+    PaStreamCallbackTimeInfo time_info;
+    time_info.inputBufferAdcTime = 0;
+    time_info.currentTime = sim->next_fire;
+    time_info.outputBufferDacTime = deadline;
+    PaStreamCallbackFlags flags = 0;
+    if (late > 0) {
+        flags |= paOutputUnderflow;
+        sim->late_callbacks++;
+        if (late > sim->worst_late) sim->worst_late = late;
+    }
+
+    if (sim->now < sim->next_fire) sim->now = sim->next_fire;
+    int result = audio_callback(NULL, sim->buffer, sim->frames_per_buffer, &time_info, flags, data);
+
+    if (sim->trace) {
+        unsigned long long silence = atomic_load(&data->stats.silence_frames);
+        fprintf(sim->trace, "%.6f,%.3f,%.3f,%.3f\n", sim->next_fire,
+                ring_buffer_available(&data->ring) * 1000.0 / ((double)sim->sample_rate * sim->channels),
+                (silence - sim->silence_seen) * 1000.0 / sim->sample_rate, late > 0 ? late * 1000.0 : 0.0);
+        sim->silence_seen = silence;
+    }
+
+    sim->next_nominal += sim->period;
+    if (result != paContinue) {
+        sim->running = 0;
+        return;
+    }
+    schedule(sim);
+}
+
+static void advance_to(SimDevice *sim, double time) {
+    while (sim->running && sim->next_fire <= time) {
+        run_callback(sim);
+    }
+    if (sim->now < time) sim->now = time;
+}
+
+void sim_device_decoded(SimDevice *sim, unsigned long long packets, double seconds) {
+    double cost = 0;
+    for (unsigned long long i = 0; i < packets; i++) {
+        cost += sim->config.decode_ms + sim->config.decode_jitter_ms * sim_random(sim);
+    }
+
+    sim->decoded += seconds;
+    while (sim->config.stall_every > 0 && sim->decoded >= sim->next_stall) {
+        cost += sim->config.stall_ms;
+        sim->stalls++;
+        sim->next_stall += sim->config.stall_every;
+    }
+    advance_to(sim, sim->now + cost / 1000.0);
+}
+
+int sim_device_wait(SimDevice *sim, int timeout_ms) {
+    Wakeup *wakeup = &sim->audio_data->wakeup;
+    double deadline = sim->now + timeout_ms / 1000.0;
+    if (wakeup_wait(wakeup, 0)) {
+        return 1;
+    }
+    while (sim->running && sim->next_fire <= deadline) {
+        run_callback(sim);
+        if (wakeup_wait(wakeup, 0)) {
+            return 1;
+        }
+    }
+    sim->now = deadline;
+    return 0;
+}
+
+void sim_device_report(const SimDevice *sim) {
+    double real = timer_now() - sim->real_start;
+    if (real <= 0) real = 1e-9;
+
+    printf("\n=== Simulation ===\n");
+    printf("Virtual time: %.2f sec in %.3f sec (%.0fx realtime)\n", sim->now, real, sim->now / real);
+    printf("Model: decode %.2f ms", sim->config.decode_ms);
+    if (sim->config.decode_jitter_ms > 0) {
+        printf(" + up to %.2f ms", sim->config.decode_jitter_ms);
+    }
+    printf(" per packet | callback jitter %.2f ms | seed %u\n", sim->config.jitter_ms, sim->config.seed);
+    if (sim->config.stall_every > 0) {
+        printf("Stalls: %llu of %.1f ms, one per %.2f sec of audio\n",
+               sim->stalls, sim->config.stall_ms, sim->config.stall_every);
+    }
+    printf("Late callbacks: %llu", sim->late_callbacks);
+    if (sim->late_callbacks > 0) {
+        printf(" (worst %.2f ms past its DAC time)", sim->worst_late * 1000.0);
+    }
+    printf("\n");
+    if (sim->trace) {
+        printf("Trace: %s\n", sim->config.trace_path);
+    }
+}
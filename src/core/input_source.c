@@ -0,0 +1,538 @@
+#include "input_source.h"
+#include "timer.h"
+#include "realtime.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define READAHEAD_MIN (2 * INPUT_BUFFER_SIZE)
+#define READAHEAD_CHUNK INPUT_BUFFER_SIZE
+#define READAHEAD_POLL_MS 100
+#define PREFETCH_STRIDE 4096
+
+// The reader thread is the only writer of head/eof (buffered) and of the
+// prefetch progress (mapped); the decode thread owns tail and the stall
+// counters. Both sides only lock to publish progress or to sleep.
+struct InputReadAhead {
+    InputSource *in;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t data_ready;   // consumer waits here
+    pthread_cond_t space_ready;  // reader waits here
+    atomic_int stop;
+    size_t depth;
+
+    // Buffered inputs: byte queue, positions count bytes since the start
+    unsigned char *queue;
+    unsigned long long head;
+    unsigned long long tail;
+    int eof;
+
+    // Mapped inputs: pages before ready are resident
+    atomic_ullong consumer;
+    atomic_ullong ready;
+    atomic_ullong wake_at;
+    unsigned long long need;
+
+    InputReadAheadStats stats;
+};
+
+#ifndef _WIN32
+static int input_map_fd(InputSource *in, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        (unsigned long long)st.st_size > (size_t)-1) {
+        return 0;
+    }
+
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) return 0;
+
+    // Playback walks the file front to back exactly once
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+    madvise(view, (size_t)st.st_size, MADV_WILLNEED);
+
+    in->data = (const unsigned char*)view;
+    in->size = (size_t)st.st_size;
+    in->mapped = 1;
+    in->eof = 1;
+    return 1;
+}
+#endif
+
+static int input_map(InputSource *in, const char *filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 ||
+        (unsigned long long)size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+
+    in->file_handle = file;
+    in->mapping_handle = mapping;
+    in->data = (const unsigned char*)view;
+    in->size = (size_t)size.QuadPart;
+    in->mapped = 1;
+    in->eof = 1;
+    return 1;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = input_map_fd(in, fd);
+    close(fd);
+    return ok;
+#endif
+}
+
+// Buffered window over stdio. The window is the only buffer, so a
+// read-ahead thread can take over the descriptor at any point.
+static int input_open_stream(InputSource *in, FILE *file) {
+    if (!file) return 0;
+    in->file = file;
+    setvbuf(in->file, NULL, _IONBF, 0);
+
+    in->buffer_capacity = INPUT_BUFFER_SIZE;
+    in->buffer = (unsigned char*)malloc(in->buffer_capacity);
+    if (!in->buffer) {
+        fclose(in->file);
+        in->file = NULL;
+        return 0;
+    }
+    in->data = in->buffer;
+    return 1;
+}
+
+// Works on a duplicate of the descriptor, so closing the input leaves the
+// process's stdin alone
+static int input_open_stdin(InputSource *in) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    int fd = _dup(_fileno(stdin));
+    return fd >= 0 && input_open_stream(in, _fdopen(fd, "rb"));
+#else
+    // Mapping starts at offset 0, so only a file that has not been read yet
+    if (lseek(STDIN_FILENO, 0, SEEK_CUR) == 0 && input_map_fd(in, STDIN_FILENO)) {
+        return 1;
+    }
+    int fd = dup(STDIN_FILENO);
+    if (fd < 0) return 0;
+    FILE *file = fdopen(fd, "rb");
+    if (!file) close(fd);
+    return input_open_stream(in, file);
+#endif
+}
+
+int input_is_stdin(const char *filename) {
+    return strcmp(filename, "-") == 0;
+}
+
+int input_open(InputSource *in, const char *filename) {
+    memset(in, 0, sizeof(*in));
+
+    if (input_is_stdin(filename)) {
+        return input_open_stdin(in);
+    }
+    if (input_map(in, filename)) {
+        return 1;
+    }
+    return input_open_stream(in, fopen(filename, "rb"));
+}
+
+// Non-owning view over bytes the caller keeps alive, e.g. a slice of a
+// mapped file handed to a worker thread
+void input_open_memory(InputSource *in, const unsigned char *data, size_t size) {
+    memset(in, 0, sizeof(*in));
+    in->data = data;
+    in->size = size;
+    in->eof = 1;
+}
+
+static void readahead_stop(InputSource *in);
+
+void input_close(InputSource *in) {
+    readahead_stop(in);
+    if (in->mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile((LPCVOID)in->data);
+        CloseHandle((HANDLE)in->mapping_handle);
+        CloseHandle((HANDLE)in->file_handle);
+#else
+        munmap((void*)in->data, in->size);
+#endif
+    }
+    if (in->file) {
+        fclose(in->file);
+    }
+    free(in->buffer);
+    memset(in, 0, sizeof(*in));
+}
+
+static void readahead_stall_begin(InputReadAhead *ra, double *start) {
+    *start = timer_now();
+    ra->stats.stalls++;
+}
+
+static void readahead_stall_end(InputReadAhead *ra, double start) {
+    ra->stats.stall_seconds += timer_now() - start;
+}
+
+// Copies up to n queued bytes, waiting only if the queue is empty
+static size_t readahead_take(InputReadAhead *ra, unsigned char *dst, size_t n) {
+    pthread_mutex_lock(&ra->lock);
+    if (ra->head == ra->tail && !ra->eof) {
+        double start;
+        readahead_stall_begin(ra, &start);
+        while (ra->head == ra->tail && !ra->eof) {
+            pthread_cond_wait(&ra->data_ready, &ra->lock);
+        }
+        readahead_stall_end(ra, start);
+    }
+    size_t queued = (size_t)(ra->head - ra->tail);
+    pthread_mutex_unlock(&ra->lock);
+
+    // Only this thread moves tail, so the copy needs no lock
+    size_t got = (queued < n) ? queued : n;
+    size_t index = (size_t)(ra->tail % ra->depth);
+    size_t first = (got < ra->depth - index) ? got : ra->depth - index;
+    memcpy(dst, ra->queue + index, first);
+    memcpy(dst + first, ra->queue, got - first);
+
+    pthread_mutex_lock(&ra->lock);
+    ra->tail += got;
+    pthread_cond_signal(&ra->space_ready);
+    pthread_mutex_unlock(&ra->lock);
+    return got;
+}
+
+// Mapped inputs: make sure the pages up to end have been faulted in by the
+// reader. The fast path is a single relaxed load.
+static void readahead_wait_mapped(InputReadAhead *ra, unsigned long long end) {
+    if (end > ra->in->size) end = ra->in->size;
+    if (end <= atomic_load_explicit(&ra->ready, memory_order_relaxed)) return;
+
+    pthread_mutex_lock(&ra->lock);
+    if (end > atomic_load(&ra->ready)) {
+        double start;
+        readahead_stall_begin(ra, &start);
+        ra->need = end;
+        pthread_cond_signal(&ra->space_ready);
+        while (end > atomic_load(&ra->ready) && !atomic_load(&ra->stop)) {
+            pthread_cond_wait(&ra->data_ready, &ra->lock);
+        }
+        readahead_stall_end(ra, start);
+    }
+    pthread_mutex_unlock(&ra->lock);
+}
+
+// Publishes the read position of a mapped input; wakes the reader once the
+// consumer is half way through what it prefetched
+static void readahead_advance(InputReadAhead *ra, unsigned long long position, int jumped) {
+    atomic_store_explicit(&ra->consumer, position, memory_order_relaxed);
+    if (!jumped && position < atomic_load_explicit(&ra->wake_at, memory_order_relaxed)) return;
+
+    pthread_mutex_lock(&ra->lock);
+    if (jumped) {
+        // Restart the prefetch window at the new position
+        atomic_store(&ra->ready, position);
+    }
+    pthread_cond_signal(&ra->space_ready);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+// Slide unread bytes to the front of the buffer and top it up so that at
+// least n bytes are buffered (or the file is exhausted)
+static void input_fill(InputSource *in, size_t n) {
+    size_t remaining = in->size - in->pos;
+
+    if (n > in->buffer_capacity) {
+        size_t capacity = in->buffer_capacity;
+        while (capacity < n) capacity *= 2;
+        unsigned char *buffer = (unsigned char*)malloc(capacity);
+        if (!buffer) return;
+        memcpy(buffer, in->buffer + in->pos, remaining);
+        free(in->buffer);
+        in->buffer = buffer;
+        in->buffer_capacity = capacity;
+    } else if (in->pos > 0) {
+        memmove(in->buffer, in->buffer + in->pos, remaining);
+    }
+
+    in->offset += in->pos;
+    in->pos = 0;
+    in->size = remaining;
+    in->data = in->buffer;
+
+    while (in->size < n && !in->eof) {
+        size_t room = in->buffer_capacity - in->size;
+        size_t got = in->readahead ? readahead_take(in->readahead, in->buffer + in->size, room)
+                                   : fread(in->buffer + in->size, 1, room, in->file);
+        if (got == 0) {
+            in->eof = 1;
+            break;
+        }
+        in->size += got;
+    }
+}
+
+size_t input_peek(InputSource *in, size_t n, const unsigned char **ptr) {
+    if (in->mapped && in->readahead) {
+        readahead_wait_mapped(in->readahead, in->offset + in->pos + n);
+    }
+    if (in->size - in->pos < n && !in->eof) {
+        input_fill(in, n);
+    }
+
+    size_t available = in->size - in->pos;
+    *ptr = in->data + in->pos;
+    return (available < n) ? available : n;
+}
+
+void input_skip(InputSource *in, size_t n) {
+    size_t available = in->size - in->pos;
+    if (n <= available || in->mapped) {
+        in->pos += (n < available) ? n : available;
+        if (in->mapped && in->readahead) {
+            readahead_advance(in->readahead, in->offset + in->pos, 0);
+        }
+        return;
+    }
+
+    // Skipping past the buffered window: pull the rest through in chunks
+    while (n > 0) {
+        const unsigned char *ptr;
+        size_t chunk = (n < in->buffer_capacity) ? n : in->buffer_capacity;
+        size_t got = input_peek(in, chunk, &ptr);
+        if (got == 0) break;
+        in->pos += got;
+        n -= got;
+    }
+}
+
+size_t input_read(InputSource *in, void *dst, size_t n) {
+    const unsigned char *src;
+    size_t got = input_peek(in, n, &src);
+    memcpy(dst, src, got);
+    input_skip(in, got);
+    return got;
+}
+
+unsigned long long input_tell(InputSource *in) {
+    return in->offset + in->pos;
+}
+
+int input_seek(InputSource *in, unsigned long long offset) {
+    if (!in->file) {
+        if (offset > in->offset + in->size) return 0;
+        in->pos = (size_t)(offset - in->offset);
+        if (in->mapped && in->readahead) {
+            readahead_advance(in->readahead, in->offset + in->pos, 1);
+        }
+        return 1;
+    }
+
+    unsigned long long current = input_tell(in);
+    if (offset < current) return 0;
+    input_skip(in, (size_t)(offset - current));
+    return input_tell(in) == offset;
+}
+
+#ifndef _WIN32
+// Blocking read that gives up when asked to stop, so a stalled pipe or
+// network mount cannot hold up shutdown
+static size_t readahead_read(InputReadAhead *ra, unsigned char *dst, size_t n) {
+    int fd = fileno(ra->in->file);
+    while (!atomic_load(&ra->stop)) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, READAHEAD_POLL_MS);
+        if (ready < 0 && errno != EINTR) return 0;
+        if (ready <= 0) continue;
+
+        ssize_t got = read(fd, dst, n);
+        if (got >= 0) return (size_t)got;
+        if (errno != EINTR && errno != EAGAIN) return 0;
+    }
+    return 0;
+}
+#else
+static size_t readahead_read(InputReadAhead *ra, unsigned char *dst, size_t n) {
+    return fread(dst, 1, n, ra->in->file);
+}
+#endif
+
+static void *readahead_fill_queue(void *arg) {
+    InputReadAhead *ra = (InputReadAhead*)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&ra->lock);
+        while (ra->head - ra->tail == ra->depth && !atomic_load(&ra->stop)) {
+            pthread_cond_wait(&ra->space_ready, &ra->lock);
+        }
+        size_t free_bytes = ra->depth - (size_t)(ra->head - ra->tail);
+        pthread_mutex_unlock(&ra->lock);
+        if (atomic_load(&ra->stop)) break;
+
+        // Only this thread moves head; read into the contiguous free span
+        size_t index = (size_t)(ra->head % ra->depth);
+        size_t span = ra->depth - index;
+        if (span > free_bytes) span = free_bytes;
+        if (span > READAHEAD_CHUNK) span = READAHEAD_CHUNK;
+        size_t got = readahead_read(ra, ra->queue + index, span);
+
+        pthread_mutex_lock(&ra->lock);
+        if (got == 0) {
+            ra->eof = 1;
+        } else {
+            ra->head += got;
+        }
+        pthread_cond_signal(&ra->data_ready);
+        pthread_mutex_unlock(&ra->lock);
+        if (got == 0) break;
+    }
+    return NULL;
+}
+
+static void *readahead_prefetch(void *arg) {
+    InputReadAhead *ra = (InputReadAhead*)arg;
+    const volatile unsigned char *data = ra->in->data;
+    unsigned long long size = ra->in->size;
+
+    for (;;) {
+        unsigned long long from, to;
+        pthread_mutex_lock(&ra->lock);
+        for (;;) {
+            from = atomic_load(&ra->ready);
+            to = atomic_load(&ra->consumer) + ra->depth;
+            if (to < ra->need) to = ra->need;
+            if (to > size) to = size;
+            if (from < to || atomic_load(&ra->stop)) break;
+            pthread_cond_wait(&ra->space_ready, &ra->lock);
+        }
+        pthread_mutex_unlock(&ra->lock);
+        if (atomic_load(&ra->stop)) break;
+
+        // Touch one byte per page; any fault is taken here, not by the decoder
+        if (to > from + READAHEAD_CHUNK) to = from + READAHEAD_CHUNK;
+        unsigned char sink = 0;
+        for (unsigned long long offset = from; offset < to; offset += PREFETCH_STRIDE) {
+            sink ^= data[offset];
+        }
+        sink ^= data[to - 1];
+        (void)sink;
+
+        pthread_mutex_lock(&ra->lock);
+        // A seek may have moved the window while the lock was dropped
+        if (atomic_load(&ra->ready) == from) {
+            atomic_store(&ra->ready, to);
+            atomic_store(&ra->wake_at, (to == size) ? ~0ULL : to - ra->depth / 2);
+        }
+        pthread_cond_broadcast(&ra->data_ready);
+        pthread_mutex_unlock(&ra->lock);
+    }
+    return NULL;
+}
+
+int input_start_readahead(InputSource *in, size_t depth) {
+    if (in->readahead || (!in->mapped && !in->file) || (in->file && in->eof)) {
+        return 0;
+    }
+    if (depth < READAHEAD_MIN) depth = READAHEAD_MIN;
+
+    InputReadAhead *ra = (InputReadAhead*)calloc(1, sizeof(InputReadAhead));
+    if (!ra) return 0;
+    ra->in = in;
+    ra->depth = depth;
+    ra->stats.depth = depth;
+    atomic_init(&ra->stop, 0);
+
+    unsigned long long position = in->offset + in->pos;
+    atomic_init(&ra->consumer, position);
+    atomic_init(&ra->ready, position);
+    atomic_init(&ra->wake_at, 0);
+
+    if (in->file) {
+        ra->queue = (unsigned char*)malloc(depth);
+        if (!ra->queue) {
+            free(ra);
+            return 0;
+        }
+    }
+
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->data_ready, NULL);
+    pthread_cond_init(&ra->space_ready, NULL);
+
+    realtime_suspend();
+    int created = pthread_create(&ra->thread, NULL, in->file ? readahead_fill_queue : readahead_prefetch, ra) == 0;
+    realtime_resume();
+    if (!created) {
+        pthread_cond_destroy(&ra->space_ready);
+        pthread_cond_destroy(&ra->data_ready);
+        pthread_mutex_destroy(&ra->lock);
+        free(ra->queue);
+        free(ra);
+        return 0;
+    }
+
+    in->readahead = ra;
+    return 1;
+}
+
+static void readahead_stop(InputSource *in) {
+    InputReadAhead *ra = in->readahead;
+    if (!ra) return;
+
+    pthread_mutex_lock(&ra->lock);
+    atomic_store(&ra->stop, 1);
+    pthread_cond_broadcast(&ra->space_ready);
+    pthread_cond_broadcast(&ra->data_ready);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+
+    pthread_cond_destroy(&ra->space_ready);
+    pthread_cond_destroy(&ra->data_ready);
+    pthread_mutex_destroy(&ra->lock);
+    free(ra->queue);
+    free(ra);
+    in->readahead = NULL;
+}
+
+int input_readahead_stats(const InputSource *in, InputReadAheadStats *stats) {
+    if (!in->readahead) return 0;
+    *stats = in->readahead->stats;
+    return 1;
+}
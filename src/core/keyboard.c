@@ -0,0 +1,92 @@
+#include "keyboard.h"
+
+#ifdef _WIN32
+#include <conio.h>
+#include <io.h>
+#include <stdio.h>
+
+int keyboard_enable(void) {
+    return _isatty(_fileno(stdin));
+}
+
+void keyboard_restore(void) {
+}
+
+// Returns KEY_SEEK_* for a seek key, 0 if nothing usable was pressed
+int keyboard_poll(void) {
+    while (_kbhit()) {
+        int c = _getch();
+        if (c == 0 || c == 224) {
+            c = _getch();
+            if (c == 75) return KEY_SEEK_BACK;     // Left arrow
+            if (c == 77) return KEY_SEEK_FORWARD;  // Right arrow
+            continue;
+        }
+        if (c == ',' || c == '<') return KEY_SEEK_BACK;
+        if (c == '.' || c == '>') return KEY_SEEK_FORWARD;
+    }
+    return 0;
+}
+#else
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+static struct termios saved_termios;
+static int enabled = 0;
+
+int keyboard_enable(void) {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_termios) != 0) {
+        return 0;
+    }
+
+    // Unbuffered, no echo; keep ISIG so Ctrl+C still raises SIGINT
+    struct termios raw = saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0) {
+        return 0;
+    }
+    enabled = 1;
+    return 1;
+}
+
+void keyboard_restore(void) {
+    if (enabled) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+        enabled = 0;
+    }
+}
+
+static int read_key(void) {
+    fd_set fds;
+    struct timeval timeout = { 0, 0 };
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &timeout) <= 0) {
+        return -1;
+    }
+
+    unsigned char c;
+    return (read(STDIN_FILENO, &c, 1) == 1) ? c : -1;
+}
+
+// Returns KEY_SEEK_* for a seek key, 0 if nothing usable was pressed
+int keyboard_poll(void) {
+    if (!enabled) return 0;
+
+    int c;
+    while ((c = read_key()) >= 0) {
+        if (c == 0x1B && read_key() == '[') {
+            c = read_key();
+            if (c == 'D') return KEY_SEEK_BACK;     // Left arrow
+            if (c == 'C') return KEY_SEEK_FORWARD;  // Right arrow
+            continue;
+        }
+        if (c == ',' || c == '<') return KEY_SEEK_BACK;
+        if (c == '.' || c == '>') return KEY_SEEK_FORWARD;
+    }
+    return 0;
+}
+#endif
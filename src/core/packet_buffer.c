@@ -10,7 +10,7 @@ void packet_buffer_free(PacketBuffer *buf) {
     free(buf->data);
 }
 
-void packet_buffer_append(PacketBuffer *buf, unsigned char *data, int len) {
+void packet_buffer_append(PacketBuffer *buf, const unsigned char *data, int len) {
     if (buf->size + len > buf->capacity) {
         buf->capacity = (buf->size + len) * 2;
         buf->data = (unsigned char*)realloc(buf->data, buf->capacity);
@@ -0,0 +1,288 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include "realtime.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Below the threads of audio servers (PipeWire, JACK). PortAudio's own
+// callback thread must always preempt the decoder, so realtime_callback()
+// lifts it to one above this when it runs lower.
+#define REALTIME_FIFO_PRIORITY 10
+#define REALTIME_NICE -10
+#define REALTIME_STACK_PREFAULT (256 * 1024)
+
+static RealtimeStatus status = { 0, "", 0, -1, 0, 0, 0 };
+
+// This thread runs with the policy (the decode thread, a mixer track), and
+// how many realtime_suspend() calls on it are outstanding
+static _Thread_local int raised;
+static _Thread_local int suspended;
+
+// This audio callback thread has been checked by realtime_callback()
+static _Thread_local int callback_checked;
+
+#ifdef _WIN32
+#include <windows.h>
+
+static void set_priority(void) {
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        snprintf(status.priority, sizeof(status.priority), "time critical");
+        return;
+    }
+    status.fifo_error = EPERM;
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST)) {
+        snprintf(status.priority, sizeof(status.priority), "highest");
+    }
+}
+
+static void apply_priority(void) {
+    SetThreadPriority(GetCurrentThread(), status.fifo_error ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_TIME_CRITICAL);
+}
+
+// Time critical is the top of the class, so a callback can only match a
+// time critical decoder
+static void raise_callback(void) {
+    if (GetThreadPriority(GetCurrentThread()) < THREAD_PRIORITY_TIME_CRITICAL) {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    }
+}
+
+static int pin(int cpu) {
+    if (cpu >= (int)(sizeof(DWORD_PTR) * 8) || !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu)) {
+        return EINVAL;
+    }
+    return 0;
+}
+
+// The working set, not the whole process, is what Windows lets us lock
+static int lock_all(void) {
+    return ENOSYS;
+}
+
+static int lock_range(void *data, size_t bytes) {
+    return VirtualLock(data, bytes) ? 0 : ENOMEM;
+}
+
+// New threads start at normal priority with the process's affinity, so
+// there is nothing to drop while spawning them
+static void save_normal(void) {
+}
+
+static void restore_normal(void) {
+}
+
+static void reapply(void) {
+}
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+static int normal_nice;
+#ifdef __linux__
+static cpu_set_t normal_cpus;
+static int have_normal_cpus;
+#endif
+
+static int set_nice(int nice) {
+#ifdef __linux__
+    // Per thread on Linux, where each thread has its own nice value
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice);
+#else
+    return setpriority(PRIO_PROCESS, 0, nice);
+#endif
+}
+
+static int set_fifo(int priority) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    int lowest = sched_get_priority_min(SCHED_FIFO);
+    param.sched_priority = priority < lowest ? lowest : priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+static void set_priority(void) {
+    status.fifo_error = set_fifo(REALTIME_FIFO_PRIORITY);
+    if (status.fifo_error == 0) {
+        snprintf(status.priority, sizeof(status.priority), "SCHED_FIFO %d", REALTIME_FIFO_PRIORITY);
+        return;
+    }
+    // RLIMIT_NICE often allows a raised nice value without SCHED_FIFO
+    if (set_nice(REALTIME_NICE) == 0) {
+        snprintf(status.priority, sizeof(status.priority), "nice %d", REALTIME_NICE);
+    }
+}
+
+static void apply_priority(void) {
+    if (status.fifo_error == 0) {
+        set_fifo(REALTIME_FIFO_PRIORITY);
+    } else if (status.priority[0]) {
+        set_nice(REALTIME_NICE);
+    }
+}
+
+// Leaves a callback already above the decoder (an audio server's thread)
+// alone. With only nice available, the callback gets the decoder's share.
+static void raise_callback(void) {
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) return;
+    if ((policy == SCHED_FIFO || policy == SCHED_RR) && param.sched_priority > REALTIME_FIFO_PRIORITY) return;
+
+    if (status.fifo_error == 0) {
+        set_fifo(REALTIME_FIFO_PRIORITY + 1);
+    } else if (status.priority[0]) {
+        set_nice(REALTIME_NICE);
+    }
+}
+
+static int pin(int cpu) {
+#ifdef __linux__
+    if (cpu >= CPU_SETSIZE) return EINVAL;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+    return ENOSYS;
+#endif
+}
+
+// Only what is mapped now: MCL_FUTURE would also lock every input file
+// mapped later, whole
+static int lock_all(void) {
+    return mlockall(MCL_CURRENT) == 0 ? 0 : errno;
+}
+
+static int lock_range(void *data, size_t bytes) {
+    return mlock(data, bytes) == 0 ? 0 : errno;
+}
+
+// Threads inherit their creator's policy, nice value and affinity, so a
+// raised thread drops back to these while it spawns one
+static void save_normal(void) {
+    errno = 0;
+#ifdef __linux__
+    int nice = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+    have_normal_cpus = pthread_getaffinity_np(pthread_self(), sizeof(normal_cpus), &normal_cpus) == 0;
+#else
+    int nice = getpriority(PRIO_PROCESS, 0);
+#endif
+    normal_nice = errno ? 0 : nice;
+}
+
+static void restore_normal(void) {
+    if (status.fifo_error == 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    } else if (status.priority[0]) {
+        set_nice(normal_nice);
+    }
+#ifdef __linux__
+    if (status.cpu >= 0 && have_normal_cpus) {
+        pthread_setaffinity_np(pthread_self(), sizeof(normal_cpus), &normal_cpus);
+    }
+#endif
+}
+
+static void reapply(void) {
+    apply_priority();
+    if (status.cpu >= 0) pin(status.cpu);
+}
+#endif
+
+// Touches the stack the decoder will grow into, so it is mapped (and
+// locked) before playback rather than on the first deep call
+static void prefault_stack(void) {
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+const RealtimeStatus *realtime_enter(int cpu) {
+    status.enabled = 1;
+    raised = 1;
+    save_normal();
+    set_priority();
+
+    status.cpu = -1;
+    if (cpu >= 0) {
+        status.pin_error = pin(cpu);
+        if (status.pin_error == 0) status.cpu = cpu;
+    }
+
+    prefault_stack();
+    status.lock_error = lock_all();
+    status.memory_locked = (status.lock_error == 0);
+    return &status;
+}
+
+void realtime_thread(void) {
+    if (!status.enabled) return;
+    raised = 1;
+    suspended = 0;
+    apply_priority();
+    if (status.cpu >= 0) pin(status.cpu);
+    prefault_stack();
+}
+
+void realtime_suspend(void) {
+    if (raised && suspended++ == 0) {
+        restore_normal();
+    }
+}
+
+void realtime_resume(void) {
+    if (raised && suspended > 0 && --suspended == 0) {
+        reapply();
+    }
+}
+
+void realtime_callback(void) {
+    if (!status.enabled || raised || callback_checked) return;
+    callback_checked = 1;
+    raise_callback();
+}
+
+int realtime_enabled(void) {
+    return status.enabled;
+}
+
+void realtime_report(void) {
+    if (!status.enabled) return;
+
+    printf("Realtime (decode threads, audio callback above them): ");
+    if (status.fifo_error == 0) {
+        printf("%s", status.priority);
+    } else {
+        printf("%s (no realtime priority: %s)", status.priority[0] ? status.priority : "normal priority",
+               strerror(status.fifo_error));
+    }
+    if (status.memory_locked) {
+        printf(" | memory locked");
+    } else {
+        printf(" | memory not locked (%s)", strerror(status.lock_error));
+    }
+    if (status.cpu >= 0) {
+        printf(" | CPU %d", status.cpu);
+    } else if (status.pin_error) {
+        printf(" | not pinned (%s)", strerror(status.pin_error));
+    }
+    printf("\n");
+}
+
+int realtime_lock(void *data, size_t bytes) {
+    if (!data || bytes == 0) return 0;
+    memset(data, 0, bytes);
+    return lock_range(data, bytes) == 0;
+}
@@ -0,0 +1,136 @@
+#include "ring_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+int ring_buffer_init(RingBuffer *rb, size_t min_capacity) {
+    size_t capacity = 1;
+    while (capacity < min_capacity) {
+        capacity <<= 1;
+    }
+
+    rb->data = (short*)calloc(capacity, sizeof(short));
+    if (!rb->data) {
+        return 0;
+    }
+    rb->capacity = capacity;
+    rb->mask = capacity - 1;
+    atomic_init(&rb->read_pos, 0);
+    atomic_init(&rb->write_pos, 0);
+    atomic_init(&rb->discard_to, 0);
+    atomic_init(&rb->discard_pending, 0);
+    return 1;
+}
+
+void ring_buffer_free(RingBuffer *rb) {
+    free(rb->data);
+    rb->data = NULL;
+    rb->capacity = 0;
+    rb->mask = 0;
+}
+
+// Only safe while neither side is running
+void ring_buffer_reset(RingBuffer *rb) {
+    atomic_store(&rb->read_pos, 0);
+    atomic_store(&rb->write_pos, 0);
+    atomic_store(&rb->discard_pending, 0);
+}
+
+void ring_buffer_discard(RingBuffer *rb) {
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    atomic_store_explicit(&rb->discard_to, w, memory_order_relaxed);
+    atomic_store_explicit(&rb->discard_pending, 1, memory_order_release);
+}
+
+// Consumer side of ring_buffer_discard(): move the read position up to the
+// requested point, never past what has been written
+static void ring_buffer_apply_discard(RingBuffer *rb) {
+    if (!atomic_load_explicit(&rb->discard_pending, memory_order_acquire)) {
+        return;
+    }
+    atomic_store_explicit(&rb->discard_pending, 0, memory_order_relaxed);
+
+    size_t to = atomic_load_explicit(&rb->discard_to, memory_order_relaxed);
+    size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+    if (to - r <= w - r) {
+        atomic_store_explicit(&rb->read_pos, to, memory_order_release);
+    }
+}
+
+size_t ring_buffer_available(RingBuffer *rb) {
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+    size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    return w - r;
+}
+
+size_t ring_buffer_space(RingBuffer *rb) {
+    size_t r = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    return rb->capacity - (w - r);
+}
+
+size_t ring_buffer_write(RingBuffer *rb, const short *src, size_t count) {
+    size_t space = ring_buffer_space(rb);
+    if (count > space) count = space;
+    if (count == 0) return 0;
+
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    size_t start = w & rb->mask;
+    size_t first = rb->capacity - start;
+    if (first > count) first = count;
+
+    memcpy(rb->data + start, src, first * sizeof(short));
+    memcpy(rb->data, src + first, (count - first) * sizeof(short));
+
+    atomic_store_explicit(&rb->write_pos, w + count, memory_order_release);
+    return count;
+}
+
+size_t ring_buffer_read(RingBuffer *rb, short *dst, size_t count) {
+    ring_buffer_apply_discard(rb);
+    size_t available = ring_buffer_available(rb);
+    if (count > available) count = available;
+    if (count == 0) return 0;
+
+    size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    size_t start = r & rb->mask;
+    size_t first = rb->capacity - start;
+    if (first > count) first = count;
+
+    memcpy(dst, rb->data + start, first * sizeof(short));
+    memcpy(dst + first, rb->data, (count - first) * sizeof(short));
+
+    atomic_store_explicit(&rb->read_pos, r + count, memory_order_release);
+    return count;
+}
+
+size_t ring_buffer_write_reserve(RingBuffer *rb, short **span) {
+    size_t space = ring_buffer_space(rb);
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    size_t start = w & rb->mask;
+    size_t contiguous = rb->capacity - start;
+
+    *span = rb->data + start;
+    return (contiguous < space) ? contiguous : space;
+}
+
+void ring_buffer_write_commit(RingBuffer *rb, size_t count) {
+    size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    atomic_store_explicit(&rb->write_pos, w + count, memory_order_release);
+}
+
+size_t ring_buffer_read_acquire(RingBuffer *rb, const short **span) {
+    ring_buffer_apply_discard(rb);
+    size_t available = ring_buffer_available(rb);
+    size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    size_t start = r & rb->mask;
+    size_t contiguous = rb->capacity - start;
+
+    *span = rb->data + start;
+    return (contiguous < available) ? contiguous : available;
+}
+
+void ring_buffer_read_release(RingBuffer *rb, size_t count) {
+    size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    atomic_store_explicit(&rb->read_pos, r + count, memory_order_release);
+}
@@ -2,8 +2,32 @@
 #include "common.h"
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <io.h>
+#define write_message(text) _write(1, text, (unsigned int)(sizeof(text) - 1))
+#else
+#include <unistd.h>
+#define write_message(text) (void)!write(STDOUT_FILENO, text, sizeof(text) - 1)
+#endif
+
 void signal_handler(int sig) {
     (void)sig;
-    printf("\n\nStopping playback...\n");
+    // printf is not safe here: the signal may land inside another stdio call
+    write_message("\n\nStopping playback...\n");
     stop_playback = 1;
 }
+
+void signal_handler_install(void) {
+#ifdef _WIN32
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+#endif
+}
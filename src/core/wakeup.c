@@ -0,0 +1,85 @@
+#include "wakeup.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+int wakeup_init(Wakeup *wakeup) {
+    wakeup->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    return wakeup->event != NULL;
+}
+
+void wakeup_free(Wakeup *wakeup) {
+    if (wakeup->event) CloseHandle(wakeup->event);
+    wakeup->event = NULL;
+}
+
+void wakeup_signal(Wakeup *wakeup) {
+    SetEvent(wakeup->event);
+}
+
+int wakeup_wait(Wakeup *wakeup, int timeout_ms) {
+    return WaitForSingleObject(wakeup->event, (DWORD)timeout_ms) == WAIT_OBJECT_0;
+}
+#else
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+int wakeup_init(Wakeup *wakeup) {
+#ifdef __linux__
+    wakeup->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wakeup->write_fd = wakeup->read_fd;
+    return wakeup->read_fd >= 0;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        wakeup->read_fd = wakeup->write_fd = -1;
+        return 0;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    wakeup->read_fd = fds[0];
+    wakeup->write_fd = fds[1];
+    return 1;
+#endif
+}
+
+void wakeup_free(Wakeup *wakeup) {
+    if (wakeup->read_fd >= 0) close(wakeup->read_fd);
+    if (wakeup->write_fd >= 0 && wakeup->write_fd != wakeup->read_fd) close(wakeup->write_fd);
+    wakeup->read_fd = wakeup->write_fd = -1;
+}
+
+void wakeup_signal(Wakeup *wakeup) {
+    // A full pipe or saturated counter already means "wake up"
+    uint64_t one = 1;
+#ifdef __linux__
+    ssize_t written = write(wakeup->write_fd, &one, sizeof(one));
+#else
+    ssize_t written = write(wakeup->write_fd, &one, 1);
+#endif
+    (void)written;
+}
+
+int wakeup_wait(Wakeup *wakeup, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = wakeup->read_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return 0;
+    }
+
+    // Drain so the next wait blocks again
+    unsigned char drain[64];
+    while (read(wakeup->read_fd, drain, sizeof(drain)) > 0) {
+    }
+    return 1;
+}
+#endif
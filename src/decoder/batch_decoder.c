@@ -0,0 +1,285 @@
+#include "batch_decoder.h"
+#include "common.h"
+#include "format_detector.h"
+#include "input_source.h"
+#include "player.h"
+#include "timer.h"
+#include "realtime.h"
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <unistd.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#define BATCH_MAX_PATH 4096
+
+typedef struct {
+    char *path;
+    int status;          // 0 ok, 1 failed, 2 not reached
+    PlayResult result;
+    double seconds;
+} BatchItem;
+
+typedef struct {
+    BatchItem *items;
+    int count;
+    int capacity;
+    atomic_int next;
+    const BatchOptions *options;
+} BatchQueue;
+
+static int batch_add(BatchQueue *queue, const char *path) {
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity ? queue->capacity * 2 : 64;
+        BatchItem *items = (BatchItem*)realloc(queue->items, capacity * sizeof(BatchItem));
+        if (!items) return 0;
+        queue->items = items;
+        queue->capacity = capacity;
+    }
+
+    BatchItem *item = &queue->items[queue->count];
+    memset(item, 0, sizeof(*item));
+    item->status = 2;
+    item->path = strdup(path);
+    if (!item->path) return 0;
+    queue->count++;
+    return 1;
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(((const BatchItem*)a)->path, ((const BatchItem*)b)->path);
+}
+
+static int batch_collect(BatchQueue *queue, const char *source) {
+    struct stat st;
+    if (stat(source, &st) != 0) {
+        fprintf(stderr, "Error: Cannot access '%s'\n", source);
+        return 0;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        if (!dir) {
+            fprintf(stderr, "Error: Cannot open directory '%s'\n", source);
+            return 0;
+        }
+
+        struct dirent *entry;
+        char path[BATCH_MAX_PATH];
+        while ((entry = readdir(dir)) != NULL) {
+            snprintf(path, sizeof(path), "%s%c%s", source, PATH_SEPARATOR, entry->d_name);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+                if (!batch_add(queue, path)) break;
+            }
+        }
+        closedir(dir);
+
+        // Directory order is arbitrary; keep reports reproducible
+        qsort(queue->items, queue->count, sizeof(BatchItem), compare_items);
+        return 1;
+    }
+
+    FILE *list = fopen(source, "r");
+    if (!list) {
+        fprintf(stderr, "Error: Cannot open file list '%s'\n", source);
+        return 0;
+    }
+
+    char line[BATCH_MAX_PATH];
+    while (fgets(line, sizeof(line), list)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        if (!batch_add(queue, line)) break;
+    }
+    fclose(list);
+    return 1;
+}
+
+static void output_path_for(const BatchOptions *options, const char *input, char *path, size_t size) {
+    const char *name = input;
+    for (const char *p = input; *p; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+
+    const char *dot = strrchr(name, '.');
+    int length = dot ? (int)(dot - name) : (int)strlen(name);
+    snprintf(path, size, "%s%c%.*s.%s", options->output_dir, PATH_SEPARATOR,
+             length, name, options->raw ? "raw" : "wav");
+}
+
+static void decode_item(BatchItem *item, const BatchOptions *options, OpusMSDecoder *decoder, short *pcm) {
+    char output_path[BATCH_MAX_PATH];
+    double start = timer_now();
+    item->status = 1;
+
+    InputSource in;
+    if (!input_open(&in, item->path)) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", item->path);
+        item->seconds = timer_now() - start;
+        return;
+    }
+
+    int is_ogg;
+    if (!detect_format(&in, &is_ogg)) {
+        fprintf(stderr, "Error: Unable to detect format of '%s'\n", item->path);
+        input_close(&in);
+        item->seconds = timer_now() - start;
+        return;
+    }
+
+    PlayerOptions player_options;
+    memset(&player_options, 0, sizeof(player_options));
+    player_options.quiet = 1;
+    player_options.decoder = decoder;
+    player_options.output.mode = options->mode;
+    player_options.output.raw = options->raw;
+    player_options.output.scratch = pcm;
+    player_options.ogg_crc = options->ogg_crc;
+    if (options->mode == OUTPUT_FILE) {
+        output_path_for(options, item->path, output_path, sizeof(output_path));
+        player_options.output.path = output_path;
+    }
+
+    int err = is_ogg ? play_ogg_opus(&in, &player_options, &item->result)
+                     : play_custom_opus(&in, &player_options, &item->result);
+    // An integrity sweep flags damaged data even when it was skipped
+    item->status = (err != 0 || item->result.decode_errors > 0 ||
+                    item->result.damage.bad_pages > 0 || item->result.damage.resyncs > 0) ? 1 : 0;
+    item->seconds = timer_now() - start;
+
+    input_close(&in);
+}
+
+// Each worker owns one decoder (sized for a stereo stream and re-initialised
+// per file; surround files get their own) and one stereo PCM scratch
+// buffer, and pulls files from a shared index
+static void *batch_worker(void *arg) {
+    BatchQueue *queue = (BatchQueue*)arg;
+
+    OpusMSDecoder *decoder = (OpusMSDecoder*)malloc(opus_multistream_decoder_get_size(1, 1));
+    short *pcm = (short*)malloc(FRAME_SIZE * 2 * sizeof(short));
+    if (!decoder || !pcm) {
+        free(decoder);
+        free(pcm);
+        return NULL;
+    }
+
+    while (!stop_playback) {
+        int index = atomic_fetch_add(&queue->next, 1);
+        if (index >= queue->count) break;
+        decode_item(&queue->items[index], queue->options, decoder, pcm);
+    }
+
+    free(decoder);
+    free(pcm);
+    return NULL;
+}
+
+static int cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int)n : 1;
+#endif
+}
+
+static void batch_report(const BatchQueue *queue, int jobs, double wall_seconds) {
+    double audio_seconds = 0, cpu_seconds = 0;
+    unsigned long long packets = 0;
+    int failed = 0;
+
+    OggDamage damage;
+    memset(&damage, 0, sizeof(damage));
+    printf("file,status,duration_s,packets,decode_errors,bad_pages,skipped_bytes,time_s\n");
+    for (int i = 0; i < queue->count; i++) {
+        const BatchItem *item = &queue->items[i];
+        double duration = item->result.sample_rate ? (double)item->result.frames / item->result.sample_rate : 0;
+        const char *status = (item->status == 0) ? "ok" : (item->status == 1) ? "FAILED" : "skipped";
+        printf("%s,%s,%.3f,%llu,%d,%llu,%llu,%.3f\n", item->path, status, duration, item->result.packets,
+               item->result.decode_errors, item->result.damage.bad_pages,
+               item->result.damage.skipped_bytes, item->seconds);
+
+        audio_seconds += duration;
+        cpu_seconds += item->seconds;
+        packets += item->result.packets;
+        damage.bad_pages += item->result.damage.bad_pages;
+        damage.resyncs += item->result.damage.resyncs;
+        damage.skipped_bytes += item->result.damage.skipped_bytes;
+        failed += (item->status != 0);
+    }
+
+    if (wall_seconds <= 0) wall_seconds = 1e-9;
+    printf("\n=== Batch Summary ===\n");
+    printf("Files: %d (%d failed) on %d workers\n", queue->count, failed, jobs);
+    printf("Audio: %.2f sec in %.3f sec wall (%.1fx realtime, %.3f sec summed file time)\n",
+           audio_seconds, wall_seconds, audio_seconds / wall_seconds, cpu_seconds);
+    printf("Packets: %llu (%.0f packets/s)\n", packets, packets / wall_seconds);
+    if (queue->options->ogg_crc != OGG_CRC_OFF) {
+        printf("CRC: %llu bad pages\n", damage.bad_pages);
+    }
+    if (damage.resyncs > 0) {
+        printf("Resync: %llu damaged regions, %llu bytes skipped\n", damage.resyncs, damage.skipped_bytes);
+    }
+}
+
+int batch_decode(const BatchOptions *options) {
+    BatchQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    atomic_init(&queue.next, 0);
+    queue.options = options;
+
+    if (!batch_collect(&queue, options->source)) {
+        return 1;
+    }
+    if (queue.count == 0) {
+        fprintf(stderr, "Error: No input files in '%s'\n", options->source);
+        free(queue.items);
+        return 1;
+    }
+
+    int jobs = options->jobs > 0 ? options->jobs : cpu_count();
+    if (jobs > queue.count) jobs = queue.count;
+
+    pthread_t *threads = (pthread_t*)malloc(jobs * sizeof(pthread_t));
+    if (!threads) {
+        free(queue.items);
+        return 1;
+    }
+
+    double start = timer_now();
+    int started = 0;
+    realtime_suspend();
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, batch_worker, &queue) != 0) break;
+        started++;
+    }
+    realtime_resume();
+    if (started == 0) {
+        // No threads available: decode on the calling thread
+        batch_worker(&queue);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double wall_seconds = timer_now() - start;
+
+    batch_report(&queue, started ? started : 1, wall_seconds);
+
+    int failed = 0;
+    for (int i = 0; i < queue.count; i++) {
+        failed |= (queue.items[i].status != 0);
+        free(queue.items[i].path);
+    }
+    free(queue.items);
+    free(threads);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include "custom_opus.h"
+
+int custom_opus_read_header(InputSource *in, CustomOpusInfo *info) {
+    memset(info, 0, sizeof(*info));
+
+    if (input_read(in, &info->header, sizeof(OpusHeader)) != sizeof(OpusHeader)) {
+        fprintf(stderr, "Error: Failed to read Opus header\n");
+        return 0;
+    }
+
+    if (memcmp(info->header.magic, "OpusHead", 8) != 0) {
+        fprintf(stderr, "Error: Invalid Opus header\n");
+        return 0;
+    }
+
+    if (info->header.version >= CUSTOM_OPUS_VERSION_INDEXED) {
+        // Later revisions may grow the extension; read what we know, skip the rest
+        CustomOpusExtension ext;
+        memset(&ext, 0, sizeof(ext));
+        const unsigned char *bytes;
+        if (input_peek(in, sizeof(unsigned int), &bytes) != sizeof(unsigned int)) {
+            fprintf(stderr, "Error: Truncated Opus header extension\n");
+            return 0;
+        }
+        memcpy(&ext.extension_size, bytes, sizeof(unsigned int));
+        if (ext.extension_size < sizeof(unsigned int)) {
+            fprintf(stderr, "Error: Invalid Opus header extension\n");
+            return 0;
+        }
+
+        size_t known = ext.extension_size < sizeof(ext) ? ext.extension_size : sizeof(ext);
+        if (input_peek(in, known, &bytes) != known) {
+            fprintf(stderr, "Error: Truncated Opus header extension\n");
+            return 0;
+        }
+        memcpy(&ext, bytes, known);
+        input_skip(in, ext.extension_size);
+
+        info->indexed = 1;
+        info->total_samples = ext.total_samples;
+        info->packet_count = ext.packet_count;
+        info->max_packet_size = ext.max_packet_size;
+        info->data_end = ext.seek_table_offset;
+        info->seek_entry_count = ext.seek_entry_count;
+    }
+
+    info->data_offset = input_tell(in);
+    if (info->data_end && info->data_end < info->data_offset) {
+        info->data_end = 0;
+    }
+
+    // The table sits after the records; only random-access inputs can use it
+    unsigned long long table_bytes = (unsigned long long)info->seek_entry_count * sizeof(CustomSeekEntry);
+    if (info->data_end && table_bytes > 0 && !in->file &&
+        info->data_end + table_bytes <= in->offset + in->size) {
+        info->seek_table = in->data + (info->data_end - in->offset);
+    } else {
+        info->seek_entry_count = 0;
+    }
+
+    if (info->max_packet_size > MAX_PACKET_SIZE) {
+        fprintf(stderr, "Warning: Packets up to %u bytes exceed the %d byte limit\n",
+                info->max_packet_size, MAX_PACKET_SIZE);
+    }
+
+    return 1;
+}
+
+int custom_opus_find_entry(const CustomOpusInfo *info, unsigned long long sample, CustomSeekEntry *entry) {
+    if (!info->seek_table || info->seek_entry_count == 0) {
+        return 0;
+    }
+
+    // Entries are in stream order; find the last one at or before sample
+    unsigned int lo = 0, hi = info->seek_entry_count;
+    while (hi - lo > 1) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        CustomSeekEntry probe;
+        memcpy(&probe, info->seek_table + (size_t)mid * sizeof(CustomSeekEntry), sizeof(probe));
+        if (probe.sample <= sample) lo = mid;
+        else hi = mid;
+    }
+
+    memcpy(entry, info->seek_table + (size_t)lo * sizeof(CustomSeekEntry), sizeof(*entry));
+    return entry->sample <= sample;
+}
+
+int custom_opus_write_indexed(InputSource *in, const CustomOpusInfo *info, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", path);
+        return 0;
+    }
+
+    OpusHeader header = info->header;
+    header.version = CUSTOM_OPUS_VERSION_INDEXED;
+
+    CustomOpusExtension ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.extension_size = sizeof(ext);
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(&ext, sizeof(ext), 1, f);
+
+    CustomSeekEntry *entries = NULL;
+    unsigned int capacity = 0;
+    unsigned long long offset = sizeof(header) + sizeof(ext);
+    unsigned long long next_entry = 0;
+    unsigned long long interval = (unsigned long long)header.sample_rate * CUSTOM_SEEK_INTERVAL_SECONDS;
+    int ok = 1;
+
+    while (!info->data_end || input_tell(in) < info->data_end) {
+        const unsigned char *record;
+        unsigned int packet_size;
+        if (input_peek(in, sizeof(unsigned int), &record) != sizeof(unsigned int)) break;
+        memcpy(&packet_size, record, sizeof(unsigned int));
+        if (packet_size > MAX_PACKET_SIZE) break;
+
+        size_t record_size = sizeof(unsigned int) + packet_size;
+        if (input_peek(in, record_size, &record) != record_size) break;
+
+        int samples = opus_packet_get_nb_samples(record + sizeof(unsigned int), packet_size, header.sample_rate);
+        if (samples < 0) {
+            fprintf(stderr, "Error: Invalid packet at offset %llu\n", input_tell(in));
+            ok = 0;
+            break;
+        }
+
+        if (ext.total_samples >= next_entry) {
+            if (ext.seek_entry_count == capacity) {
+                capacity = capacity ? capacity * 2 : 256;
+                CustomSeekEntry *grown = (CustomSeekEntry*)realloc(entries, capacity * sizeof(CustomSeekEntry));
+                if (!grown) {
+                    fprintf(stderr, "Error: Failed to allocate seek table\n");
+                    ok = 0;
+                    break;
+                }
+                entries = grown;
+            }
+            entries[ext.seek_entry_count].offset = offset;
+            entries[ext.seek_entry_count].sample = ext.total_samples;
+            ext.seek_entry_count++;
+            next_entry = ext.total_samples + interval;
+        }
+
+        fwrite(record, 1, record_size, f);
+        input_skip(in, record_size);
+
+        offset += record_size;
+        ext.total_samples += samples;
+        ext.packet_count++;
+        if (packet_size > ext.max_packet_size) ext.max_packet_size = packet_size;
+    }
+
+    ext.seek_table_offset = offset;
+    if (ok) {
+        fwrite(entries, sizeof(CustomSeekEntry), ext.seek_entry_count, f);
+        ok = fseek(f, sizeof(header), SEEK_SET) == 0 && fwrite(&ext, sizeof(ext), 1, f) == 1;
+    }
+    if (fclose(f) != 0) ok = 0;
+    free(entries);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write '%s'\n", path);
+        return 0;
+    }
+
+    printf("Wrote %s: %u packets, %.2f sec, %u seek entries\n", path, ext.packet_count,
+           (double)ext.total_samples / header.sample_rate, ext.seek_entry_count);
+    return 1;
+}
@@ -1,157 +1,223 @@
 #include "player.h"
 #include "common.h"
-#include "audio_callback.h"
+#include "audio_output.h"
+#include "custom_opus.h"
+#include "keyboard.h"
+
+typedef struct {
+    InputSource *in;
+    OpusMSDecoder *decoder;
+    AudioOutput *out;
+    const CustomOpusInfo *info;
+    int rate;                        // decode rate, which positions count in
+    unsigned long long next_sample;  // stream sample the next record decodes to
+} CustomSeeker;
+
+// The seek table and declared length count samples at the header's rate,
+// which is not necessarily the decode rate
+static unsigned long long from_header_rate(const CustomOpusInfo *info, int rate, unsigned long long samples) {
+    int header_rate = (int)info->header.sample_rate;
+    if (header_rate <= 0 || header_rate == rate) return samples;
+    return samples * rate / header_rate;
+}
 
-int play_custom_opus(const char *filename) {
-    FILE *fin = fopen(filename, "rb");
-    if (!fin) {
-        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
-        return 1;
+static unsigned long long to_header_rate(const CustomOpusInfo *info, int rate, unsigned long long samples) {
+    int header_rate = (int)info->header.sample_rate;
+    if (header_rate <= 0 || header_rate == rate) return samples;
+    return samples * header_rate / rate;
+}
+
+// Makes the next length-prefixed record visible without consuming it;
+// returns its total size, or 0 at the end of the packet data
+static size_t peek_record(InputSource *in, const CustomOpusInfo *info,
+                          const unsigned char **packet, unsigned int *packet_size) {
+    if (info->data_end && input_tell(in) >= info->data_end) {
+        return 0;
     }
 
-    // Read header
-    OpusHeader header;
-    if (fread(&header, sizeof(OpusHeader), 1, fin) != 1) {
-        fprintf(stderr, "Error: Failed to read Opus header\n");
-        fclose(fin);
-        return 1;
+    const unsigned char *record;
+    if (input_peek(in, sizeof(unsigned int), &record) != sizeof(unsigned int)) {
+        return 0;
+    }
+    memcpy(packet_size, record, sizeof(unsigned int));
+    if (*packet_size > MAX_PACKET_SIZE) return 0;
+
+    size_t record_size = sizeof(unsigned int) + *packet_size;
+    if (input_peek(in, record_size, &record) != record_size) return 0;
+    *packet = record + sizeof(unsigned int);
+    return record_size;
+}
+
+// Same contract as the Ogg seek: the next committed frame is the sample at
+// content time seconds. The seek table (or a rewind on random-access
+// inputs) gets close; the remaining records are skipped by their TOC
+// sample counts, without decoding, up to the pre-roll point.
+static int seek_custom(CustomSeeker *seeker, double seconds) {
+    if (seconds < 0) seconds = 0;
+    const CustomOpusInfo *info = seeker->info;
+    int rate = seeker->rate;
+    long long target = (long long)(seconds * rate) + (long long)info->header.pre_skip * rate / SAMPLE_RATE;
+    long long preroll_target = target - (long long)OPUS_PREROLL_SAMPLES * rate / SAMPLE_RATE;
+    if (preroll_target < 0) preroll_target = 0;
+
+    InputSource *in = seeker->in;
+    CustomSeekEntry entry;
+    int found = custom_opus_find_entry(info, to_header_rate(info, rate, (unsigned long long)preroll_target), &entry);
+    unsigned long long entry_sample = found ? from_header_rate(info, rate, entry.sample) : 0;
+
+    if (found && (entry_sample > seeker->next_sample || (long long)seeker->next_sample > preroll_target) &&
+        input_seek(in, entry.offset)) {
+        seeker->next_sample = entry_sample;
+    } else if ((long long)seeker->next_sample > preroll_target) {
+        if (!input_seek(in, info->data_offset)) {
+            return 0;
+        }
+        seeker->next_sample = 0;
     }
 
-    if (memcmp(header.magic, "OpusHead", 8) != 0) {
-        fprintf(stderr, "Error: Invalid Opus header\n");
-        fclose(fin);
+    // Walk forward by record headers only
+    for (;;) {
+        const unsigned char *packet;
+        unsigned int packet_size;
+        size_t record_size = peek_record(in, info, &packet, &packet_size);
+        if (record_size == 0) break;
+
+        int samples = opus_packet_get_nb_samples(packet, packet_size, rate);
+        if (samples <= 0 || (long long)(seeker->next_sample + samples) > preroll_target) {
+            break;
+        }
+        input_skip(in, record_size);
+        seeker->next_sample += samples;
+    }
+
+    audio_output_flush(seeker->out);
+    opus_multistream_decoder_ctl(seeker->decoder, OPUS_RESET_STATE);
+    audio_output_skip(seeker->out, (unsigned long long)(target - (long long)seeker->next_sample));
+    audio_output_set_position(seeker->out, target);
+    return 1;
+}
+
+int play_custom_opus(InputSource *in, const PlayerOptions *options, PlayResult *result) {
+    // Read header (and the version 2 extension)
+    CustomOpusInfo info;
+    if (!custom_opus_read_header(in, &info)) {
         return 1;
     }
 
-    int channels = header.channel_count;
-    int sample_rate = header.sample_rate;
+    int channels = info.header.channel_count;
+    int sample_rate = player_decode_rate(options, (int)info.header.sample_rate);
 
-    printf("\n=== Playing Custom Opus ===\n");
-    printf("Channels: %d\n", channels);
-    printf("Sample Rate: %d Hz\n", sample_rate);
-    printf("\nPress Ctrl+C to stop\n\n");
+    // The header has no mapping table, so only family 0 layouts can be decoded
+    if (channels < 1 || channels > 2) {
+        fprintf(stderr, "Error: Unsupported channel count %d (no channel mapping table)\n", channels);
+        return 1;
+    }
+    OpusHeadInfo head;
+    head.channels = channels;
+    head.mapping_family = 0;
+    opus_head_default_mapping(&head, channels);
 
     // Create decoder
     int err;
-    OpusDecoder *decoder = opus_decoder_create(sample_rate, channels, &err);
-    if (err != OPUS_OK) {
+    OpusMSDecoder *decoder = player_decoder_create(options, sample_rate, &head, &err);
+    if (!decoder) {
         fprintf(stderr, "Error: Failed to create decoder: %s\n", opus_strerror(err));
-        fclose(fin);
         return 1;
     }
 
-    // Initialize PortAudio
-    err = Pa_Initialize();
-    if (err != paNoError) {
-        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
-        opus_decoder_destroy(decoder);
-        fclose(fin);
-        return 1;
+    // Open output (device, file or null sink), sized from the declared length
+    OutputConfig config = options->output;
+    if (info.total_samples) {
+        long long start = (long long)info.header.pre_skip * sample_rate / SAMPLE_RATE;
+        if (options->start_seconds > 0) {
+            start += (long long)(options->start_seconds * sample_rate);
+        }
+        long long remaining = (long long)from_header_rate(&info, sample_rate, info.total_samples) - start;
+        config.length_frames = remaining > 0 ? (unsigned long long)remaining : 0;
     }
 
-    // Setup audio data
-    AudioData audio_data;
-    audio_data.buffer_size = sample_rate * channels * BUFFER_SIZE_SECONDS;
-    audio_data.pcm_buffer = (short*)calloc(audio_data.buffer_size, sizeof(short));
-    audio_data.read_position = 0;
-    audio_data.write_position = 0;
-    audio_data.channels = channels;
-    audio_data.decoding_finished = 0;
-    audio_data.playback_finished = 0;
-
-    // Open audio stream
-    PaStreamParameters outputParameters;
-    outputParameters.device = Pa_GetDefaultOutputDevice();
-    outputParameters.channelCount = channels;
-    outputParameters.sampleFormat = paInt16;
-    outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
-    outputParameters.hostApiSpecificStreamInfo = NULL;
-
-    PaStream *stream;
-    err = Pa_OpenStream(&stream, NULL, &outputParameters, sample_rate,
-                        256, paClipOff, audio_callback, &audio_data);
-    
-    if (err != paNoError) {
-        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
-        free(audio_data.pcm_buffer);
-        Pa_Terminate();
-        opus_decoder_destroy(decoder);
-        fclose(fin);
+    AudioOutput local;
+    int decode_errors = 0;
+    AudioOutput *out = player_open_output(options, &local, &config, sample_rate, channels);
+    if (!out) {
+        player_decoder_destroy(options, decoder);
         return 1;
     }
 
-    // Start stream
-    Pa_StartStream(stream);
-    printf("Audio stream started\n");
+    // After opening, so "-o -" has already moved console output to stderr
+    if (!options->quiet) {
+        if (options->title) {
+            printf("\n%s", options->title);
+        }
+        printf("\n=== Playing Custom Opus ===\n");
+        printf("Channels: %d\n", channels);
+        printf("Sample Rate: %u Hz\n", info.header.sample_rate);
+        printf("Decode Sample Rate: %d Hz\n", sample_rate);
+        if (info.total_samples) {
+            printf("Duration: %.2f sec (%u packets)\n",
+                   (double)from_header_rate(&info, sample_rate, info.total_samples) / sample_rate, info.packet_count);
+        }
+        if (info.seek_entry_count) {
+            printf("Seek table: %u entries\n", info.seek_entry_count);
+        }
+        printf("\nPress Ctrl+C to stop\n\n");
+    }
 
-    // Decode and buffer
-    unsigned char *opus_data = (unsigned char*)malloc(MAX_PACKET_SIZE);
-    short *pcm = (short*)malloc(FRAME_SIZE * channels * sizeof(short));
-    int frame_count = 0;
+    long long pre_skip = (long long)info.header.pre_skip * sample_rate / SAMPLE_RATE;
+    player_start_stream(decoder, out, (short)info.header.gain, (int)pre_skip);
 
-    while (!stop_playback) {
-        unsigned int packet_size;
-        if (fread(&packet_size, sizeof(unsigned int), 1, fin) != 1) {
-            break;
-        }
+    CustomSeeker seeker;
+    memset(&seeker, 0, sizeof(seeker));
+    seeker.in = in;
+    seeker.decoder = decoder;
+    seeker.out = out;
+    seeker.info = &info;
+    seeker.rate = sample_rate;
 
-        if (packet_size > MAX_PACKET_SIZE) break;
+    if (options->start_seconds > 0 && !seek_custom(&seeker, options->start_seconds)) {
+        fprintf(stderr, "Warning: Cannot seek to %.2f sec\n", options->start_seconds);
+    }
 
-        if (fread(opus_data, 1, packet_size, fin) != packet_size) break;
+    int interactive = options->output.mode == OUTPUT_DEVICE && !options->quiet && keyboard_enable();
+    if (interactive) {
+        printf("Seek: Left/Right arrows or ,/. (%d sec)\n\n", SEEK_STEP_SECONDS);
+    }
 
-        int num_samples = opus_decode(decoder, opus_data, packet_size, pcm, FRAME_SIZE, 0);
+    while (!audio_output_stopped(out)) {
+        // Length prefix and packet are decoded in place from the input window
+        const unsigned char *opus_data;
+        unsigned int packet_size;
+        size_t record_size = peek_record(in, &info, &opus_data, &packet_size);
+        if (record_size == 0) break;
+        input_skip(in, record_size);
+
+        int num_samples = player_decode(decoder, out, opus_data, packet_size);
         if (num_samples < 0) {
             fprintf(stderr, "Decode error: %s\n", opus_strerror(num_samples));
+            decode_errors++;
             break;
         }
 
-        // Wait if buffer is getting full
-        while ((audio_data.write_position - audio_data.read_position) > 
-               (sample_rate * channels * 5) && !stop_playback) {
-            Pa_Sleep(10);
-        }
+        seeker.next_sample += num_samples;
+        audio_output_progress(out);
 
-        // Copy to buffer with circular buffering
-        int samples_to_write = num_samples * channels;
-        for (int j = 0; j < samples_to_write; j++) {
-            audio_data.pcm_buffer[(audio_data.write_position + j) % audio_data.buffer_size] = pcm[j];
-        }
-        audio_data.write_position += samples_to_write;
-
-        frame_count++;
-        
-        if (frame_count % 50 == 0) {
-            float duration = (float)audio_data.write_position / (sample_rate * channels);
-            int buffered = audio_data.write_position - audio_data.read_position;
-            printf("\rDecoded: %.2f sec | Buffered: %.2f sec", 
-                   duration, (float)buffered / (sample_rate * channels));
-            fflush(stdout);
+        int key = interactive ? keyboard_poll() : 0;
+        if (key) {
+            double now = (double)(audio_output_play_position(out) - pre_skip) / sample_rate;
+            double step = (key == KEY_SEEK_FORWARD) ? SEEK_STEP_SECONDS : -SEEK_STEP_SECONDS;
+            seek_custom(&seeker, now + step);
         }
     }
 
-    // Mark decoding as finished
-    audio_data.decoding_finished = 1;
-    printf("\n\nDecoding finished, waiting for playback...\n");
-
-    // Wait for playback to finish
-    while (!audio_data.playback_finished && !stop_playback) {
-        Pa_Sleep(100);
-        int remaining = audio_data.write_position - audio_data.read_position;
-        printf("\rRemaining: %.2f seconds", (float)remaining / (sample_rate * channels));
-        fflush(stdout);
+    if (interactive) {
+        keyboard_restore();
     }
 
-    printf("\n✓ Playback finished\n");
+    player_finish(options, out, in, decode_errors, result);
 
     // Cleanup
-    Pa_StopStream(stream);
-    Pa_CloseStream(stream);
-    Pa_Terminate();
-    free(opus_data);
-    free(pcm);
-    free(audio_data.pcm_buffer);
-    opus_decoder_destroy(decoder);
-    fclose(fin);
+    player_close_output(options, out);
+    player_decoder_destroy(options, decoder);
 
     return 0;
 }
@@ -0,0 +1,469 @@
+#include "mixer_server.h"
+#include "common.h"
+#include "format_detector.h"
+#include "input_source.h"
+#include "audio_backend.h"
+#include "mixer.h"
+#include "realtime.h"
+#include <stdarg.h>
+
+#define MIXER_PATH_MAX 4096
+#define MIXER_LINE_MAX (MIXER_PATH_MAX + 64)
+#define MIXER_MAX_CLIENTS 16
+#define MIXER_POLL_MS 100
+
+#ifdef _WIN32
+
+int mixer_serve(const PlayerOptions *options, const char *socket_path) {
+    (void)options;
+    (void)socket_path;
+    fprintf(stderr, "Error: The mixer needs Unix domain sockets\n");
+    return 1;
+}
+
+int mixer_send(const char *socket_path, const char *command) {
+    (void)socket_path;
+    (void)command;
+    fprintf(stderr, "Error: The mixer needs Unix domain sockets\n");
+    return 1;
+}
+
+const char *mixer_default_socket(void) {
+    return "opusplay.sock";
+}
+
+#else
+
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+typedef struct {
+    int id;
+    char path[MIXER_PATH_MAX];
+    MixerSource *source;
+    PlayerOptions options;   // the server's, pointed at source
+    pthread_t thread;
+    atomic_int done;
+    int result;
+} MixerTrack;
+
+typedef struct {
+    int fd;
+    char line[MIXER_LINE_MAX];
+    size_t length;
+} MixerClient;
+
+typedef struct {
+    Mixer *mixer;
+    PlayerOptions options;   // template for every track
+    MixerTrack *tracks[MIXER_MAX_SOURCES];
+    int next_id;
+    MixerClient clients[MIXER_MAX_CLIENTS];
+    int quit;
+} MixerServer;
+
+const char *mixer_default_socket(void) {
+    static char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    snprintf(path, sizeof(path), "%s/opusplay.sock", (dir && dir[0]) ? dir : "/tmp");
+    return path;
+}
+
+static int socket_address(const char *socket_path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: '%s'\n", socket_path);
+        return 0;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return 1;
+}
+
+static int connect_socket(const struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_socket(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr)) {
+        return -1;
+    }
+
+    // A socket nobody answers on is left over from a server that died
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && !S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Error: '%s' exists and is not a socket\n", socket_path);
+        return -1;
+    }
+    int probe = connect_socket(&addr);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "Error: A mixer is already running on '%s'\n", socket_path);
+        return -1;
+    }
+    unlink(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        chmod(socket_path, 0600) != 0 || listen(fd, MIXER_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "Error: Cannot listen on '%s'\n", socket_path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void reply(int fd, const char *format, ...) {
+    char line[MIXER_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) return;
+    if (length > (int)sizeof(line) - 2) length = (int)sizeof(line) - 2;
+    line[length++] = '\n';
+    // A client that hung up must not take the server down with SIGPIPE
+    send(fd, line, (size_t)length, MSG_NOSIGNAL);
+}
+
+static void *track_thread(void *arg) {
+    MixerTrack *track = (MixerTrack*)arg;
+    track->result = 1;
+    realtime_thread();
+
+    InputSource in;
+    if (!input_open(&in, track->path)) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", track->path);
+    } else {
+        input_start_readahead(&in, INPUT_READAHEAD_DEFAULT);
+        int is_ogg;
+        if (!detect_format(&in, &is_ogg)) {
+            fprintf(stderr, "Error: Unable to detect format of '%s'\n", track->path);
+        } else {
+            track->result = is_ogg ? play_ogg_opus(&in, &track->options, NULL)
+                                   : play_custom_opus(&in, &track->options, NULL);
+        }
+        input_close(&in);
+    }
+
+    atomic_store(&track->done, 1);
+    return NULL;
+}
+
+static MixerTrack *find_track(MixerServer *server, int id) {
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        if (server->tracks[i] && server->tracks[i]->id == id) return server->tracks[i];
+    }
+    return NULL;
+}
+
+static void command_play(MixerServer *server, int fd, char *args) {
+    double gain_db = 0.0;
+    if (strncmp(args, "-g ", 3) == 0) {
+        char *end;
+        gain_db = strtod(args + 3, &end);
+        args = end;
+        while (*args == ' ') args++;
+    }
+    if (args[0] == '\0' || strcmp(args, "-") == 0) {
+        reply(fd, "error play needs a file path");
+        return;
+    }
+    if (strlen(args) >= MIXER_PATH_MAX) {
+        reply(fd, "error path too long");
+        return;
+    }
+
+    int slot = 0;
+    while (slot < MIXER_MAX_SOURCES && server->tracks[slot]) slot++;
+    MixerTrack *track = (slot < MIXER_MAX_SOURCES) ? (MixerTrack*)calloc(1, sizeof(MixerTrack)) : NULL;
+    MixerSource *source = track ? mixer_add(server->mixer, gain_db) : NULL;
+    if (!source) {
+        reply(fd, "error all %d sources are playing", MIXER_MAX_SOURCES);
+        free(track);
+        return;
+    }
+
+    track->id = ++server->next_id;
+    strcpy(track->path, args);
+    track->source = source;
+    track->options = server->options;
+    track->options.output.mixer_source = source;
+    atomic_init(&track->done, 0);
+    if (pthread_create(&track->thread, NULL, track_thread, track) != 0) {
+        reply(fd, "error cannot start a decode thread");
+        mixer_remove(server->mixer, source);
+        free(track);
+        return;
+    }
+
+    server->tracks[slot] = track;
+    printf("[%d] Playing %s (%+.1f dB)\n", track->id, track->path, gain_db);
+    fflush(stdout);
+    reply(fd, "ok %d", track->id);
+}
+
+static void handle_command(MixerServer *server, int fd, char *line) {
+    char *args = line;
+    while (*args && *args != ' ') args++;
+    if (*args) *args++ = '\0';
+    while (*args == ' ') args++;
+
+    if (strcmp(line, "play") == 0) {
+        command_play(server, fd, args);
+    } else if (strcmp(line, "stop") == 0 || strcmp(line, "gain") == 0) {
+        char *end;
+        MixerTrack *track = find_track(server, (int)strtol(args, &end, 10));
+        if (!track) {
+            reply(fd, "error no source %s", args);
+        } else if (line[0] == 's') {
+            mixer_source_cancel(track->source);
+            reply(fd, "ok");
+        } else {
+            mixer_source_set_gain(track->source, strtod(end, NULL));
+            reply(fd, "ok");
+        }
+    } else if (strcmp(line, "list") == 0) {
+        int count = 0;
+        for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+            MixerTrack *track = server->tracks[i];
+            if (!track) continue;
+            reply(fd, "%d %.2f %+.1f %s", track->id, mixer_source_seconds(track->source),
+                  mixer_source_gain(track->source), track->path);
+            count++;
+        }
+        reply(fd, "ok %d", count);
+    } else if (strcmp(line, "quit") == 0) {
+        server->quit = 1;
+        reply(fd, "ok");
+    } else {
+        reply(fd, "error unknown command '%s'", line);
+    }
+}
+
+// Runs every complete line the client has sent; 0 once it hangs up
+static int read_client(MixerServer *server, MixerClient *client) {
+    ssize_t n = read(client->fd, client->line + client->length, sizeof(client->line) - 1 - client->length);
+    if (n <= 0) return 0;
+    client->length += (size_t)n;
+
+    char *start = client->line;
+    char *newline;
+    while ((newline = memchr(start, '\n', client->length - (size_t)(start - client->line))) != NULL) {
+        *newline = '\0';
+        if (newline > start && newline[-1] == '\r') newline[-1] = '\0';
+        handle_command(server, client->fd, start);
+        start = newline + 1;
+    }
+    client->length -= (size_t)(start - client->line);
+    memmove(client->line, start, client->length);
+
+    if (client->length == sizeof(client->line) - 1) {
+        reply(client->fd, "error line too long");
+        return 0;
+    }
+    return 1;
+}
+
+static void reap_tracks(MixerServer *server) {
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        MixerTrack *track = server->tracks[i];
+        if (!track || !atomic_load(&track->done)) continue;
+
+        pthread_join(track->thread, NULL);
+        const char *how = mixer_source_cancelled(track->source) ? "Stopped"
+                        : track->result == 0 ? "Finished" : "Failed";
+        printf("[%d] %s %s\n", track->id, how, track->path);
+        fflush(stdout);
+        mixer_remove(server->mixer, track->source);
+        free(track);
+        server->tracks[i] = NULL;
+    }
+}
+
+static void stop_tracks(MixerServer *server) {
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        if (server->tracks[i]) mixer_source_cancel(server->tracks[i]->source);
+    }
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        MixerTrack *track = server->tracks[i];
+        if (!track) continue;
+        pthread_join(track->thread, NULL);
+        mixer_remove(server->mixer, track->source);
+        free(track);
+        server->tracks[i] = NULL;
+    }
+}
+
+static void serve(MixerServer *server, int listen_fd) {
+    while (!stop_playback && !server->quit) {
+        struct pollfd fds[1 + MIXER_MAX_CLIENTS];
+        int owner[1 + MIXER_MAX_CLIENTS];
+        int count = 0;
+        fds[count].fd = listen_fd;
+        fds[count].events = POLLIN;
+        owner[count++] = -1;
+        for (int i = 0; i < MIXER_MAX_CLIENTS; i++) {
+            if (server->clients[i].fd < 0) continue;
+            fds[count].fd = server->clients[i].fd;
+            fds[count].events = POLLIN;
+            owner[count++] = i;
+        }
+
+        // Wakes for commands, and often enough to reap finished tracks
+        int ready = poll(fds, (nfds_t)count, MIXER_POLL_MS);
+        for (int k = 0; k < count && ready > 0; k++) {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            if (owner[k] < 0) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0) continue;
+                int i = 0;
+                while (i < MIXER_MAX_CLIENTS && server->clients[i].fd >= 0) i++;
+                if (i == MIXER_MAX_CLIENTS) {
+                    reply(fd, "error too many clients");
+                    close(fd);
+                    continue;
+                }
+                server->clients[i].fd = fd;
+                server->clients[i].length = 0;
+            } else {
+                MixerClient *client = &server->clients[owner[k]];
+                if (!read_client(server, client)) {
+                    close(client->fd);
+                    client->fd = -1;
+                }
+            }
+        }
+        reap_tracks(server);
+    }
+}
+
+int mixer_serve(const PlayerOptions *options, const char *socket_path) {
+    MixerServer *server = (MixerServer*)calloc(1, sizeof(MixerServer));
+    if (!server) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < MIXER_MAX_CLIENTS; i++) {
+        server->clients[i].fd = -1;
+    }
+
+    int rate = options->output.device_rate > 0 ? options->output.device_rate : audio_backend_device_rate();
+    if (rate <= 0) rate = SAMPLE_RATE;
+    int channels = options->output.device_channels > 0 ? options->output.device_channels : 2;
+
+    // Tracks play quietly into the mixer, at its rate and channel count
+    server->options = *options;
+    server->options.quiet = 1;
+    server->options.decoder = NULL;
+    server->options.shared_output = NULL;
+    server->options.seek_index_path = NULL;
+    server->options.title = NULL;
+    server->options.output.mode = OUTPUT_DEVICE;
+    server->options.output.device_rate = rate;
+    server->options.output.device_channels = channels;
+    server->options.output.stats = 0;
+    server->options.output.stats_json = NULL;
+    server->options.output.launch_time = 0;
+
+    int listen_fd = listen_socket(socket_path);
+    if (listen_fd < 0) {
+        free(server);
+        return 1;
+    }
+
+    server->mixer = mixer_create(rate, channels, options->output.frames_per_buffer, options->output.latency_ms);
+    if (!server->mixer) {
+        close(listen_fd);
+        unlink(socket_path);
+        free(server);
+        return 1;
+    }
+    printf("Mixer: up to %d sources, %s accumulate\n", MIXER_MAX_SOURCES, mixer_kernel());
+    printf("Listening on %s\n\n", socket_path);
+    fflush(stdout);
+
+    serve(server, listen_fd);
+
+    stop_tracks(server);
+    for (int i = 0; i < MIXER_MAX_CLIENTS; i++) {
+        if (server->clients[i].fd >= 0) close(server->clients[i].fd);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    mixer_destroy(server->mixer);
+    free(server);
+    return 0;
+}
+
+int mixer_send(const char *socket_path, const char *command) {
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr)) {
+        return 1;
+    }
+
+    // The server may run elsewhere in the tree; give it an absolute path
+    char line[MIXER_LINE_MAX];
+    char resolved[PATH_MAX];
+    const char *path = NULL;
+    int prefix = 0;
+    if (strncmp(command, "play ", 5) == 0) {
+        path = command + 5;
+        if (strncmp(path, "-g ", 3) == 0) {
+            path += 3;
+            while (*path == ' ') path++;
+            while (*path && *path != ' ') path++;
+        }
+        while (*path == ' ') path++;
+        prefix = (int)(path - command);
+    }
+    if (path && path[0] != '/' && realpath(path, resolved)) {
+        snprintf(line, sizeof(line), "%.*s%s\n", prefix, command, resolved);
+    } else {
+        snprintf(line, sizeof(line), "%s\n", command);
+    }
+
+    int fd = connect_socket(&addr);
+    if (fd < 0) {
+        fprintf(stderr, "Error: No mixer running on '%s'\n", socket_path);
+        return 1;
+    }
+    if (send(fd, line, strlen(line), MSG_NOSIGNAL) < 0) {
+        fprintf(stderr, "Error: Cannot send to '%s'\n", socket_path);
+        close(fd);
+        return 1;
+    }
+
+    // Reply lines up to the final "ok" or "error"
+    FILE *replies = fdopen(fd, "r");
+    if (!replies) {
+        close(fd);
+        return 1;
+    }
+    int result = 1;
+    while (fgets(line, sizeof(line), replies)) {
+        fputs(line, stdout);
+        if (strncmp(line, "ok", 2) == 0) {
+            result = 0;
+            break;
+        }
+        if (strncmp(line, "error", 5) == 0) break;
+    }
+    fclose(replies);
+    return result;
+}
+
+#endif
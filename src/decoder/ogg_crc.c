@@ -0,0 +1,180 @@
+#include "ogg_crc.h"
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define OGG_CRC_HAVE_PCLMUL 1
+#endif
+
+#define OGG_CRC_POLY 0x04C11DB7u
+#define OGG_CHECKSUM_OFFSET 22
+
+// crc_table[k][b]: contribution of byte b followed by k zero bytes
+static unsigned int crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+#ifdef OGG_CRC_HAVE_PCLMUL
+#define FOLD_MIN_SIZE 128
+static int have_pclmul;
+// x^(d+64) and x^d mod P in the high and low halves, for folding a 128-bit
+// block forward by d bits
+static unsigned long long fold_128[2], fold_256[2], fold_384[2], fold_512[2];
+
+// x^n mod P
+static unsigned int xpow_mod(int n) {
+    unsigned int r = 1;
+    while (n-- > 0) {
+        r = (r & 0x80000000u) ? (r << 1) ^ OGG_CRC_POLY : (r << 1);
+    }
+    return r;
+}
+
+static void fold_constants(unsigned long long k[2], int bits) {
+    k[1] = xpow_mod(bits + 64);
+    k[0] = xpow_mod(bits);
+}
+#endif
+
+static void crc_init(void) {
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int r = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            r = (r & 0x80000000u) ? (r << 1) ^ OGG_CRC_POLY : (r << 1);
+        }
+        crc_table[0][i] = r;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            unsigned int prev = crc_table[k - 1][i];
+            crc_table[k][i] = (prev << 8) ^ crc_table[0][prev >> 24];
+        }
+    }
+
+#ifdef OGG_CRC_HAVE_PCLMUL
+    have_pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    fold_constants(fold_128, 128);
+    fold_constants(fold_256, 256);
+    fold_constants(fold_384, 384);
+    fold_constants(fold_512, 512);
+#endif
+}
+
+unsigned int ogg_crc_update_bytewise(unsigned int crc, const unsigned char *data, size_t size) {
+    pthread_once(&crc_once, crc_init);
+    while (size--) {
+        crc = (crc << 8) ^ crc_table[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+static unsigned int crc_slice8(unsigned int crc, const unsigned char *data, size_t size) {
+    // The first four bytes fold into the running CRC, the last four are
+    // looked up on their own; all eight lookups are independent
+    while (size >= 8) {
+        crc ^= ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) |
+               ((unsigned int)data[2] << 8) | data[3];
+        crc = crc_table[7][crc >> 24] ^ crc_table[6][(crc >> 16) & 0xFF] ^
+              crc_table[5][(crc >> 8) & 0xFF] ^ crc_table[4][crc & 0xFF] ^
+              crc_table[3][data[4]] ^ crc_table[2][data[5]] ^
+              crc_table[1][data[6]] ^ crc_table[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        crc = (crc << 8) ^ crc_table[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+#ifdef OGG_CRC_HAVE_PCLMUL
+// Carry-less multiply folding (Intel, "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ"). Blocks are loaded byte-reversed so bit 127
+// is the first bit of the message. Folding keeps a 128-bit value congruent
+// to the data so far modulo P; its CRC, continued over the bytes that did
+// not fill a block, is the CRC of the whole input.
+__attribute__((target("pclmul,ssse3")))
+static __m128i fold(__m128i x, const unsigned long long k[2], __m128i next) {
+    __m128i kk = _mm_set_epi64x((long long)k[1], (long long)k[0]);
+    __m128i hi = _mm_clmulepi64_si128(x, kk, 0x11);
+    __m128i lo = _mm_clmulepi64_si128(x, kk, 0x00);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static unsigned int crc_pclmul(unsigned int crc, const unsigned char *data, size_t size) {
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+#define LOAD(p) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p)), reverse)
+
+    // Four independent accumulators hide the multiply latency; the running
+    // CRC enters as the first 32 bits of the message
+    __m128i a0 = _mm_xor_si128(LOAD(data), _mm_set_epi32((int)crc, 0, 0, 0));
+    __m128i a1 = LOAD(data + 16);
+    __m128i a2 = LOAD(data + 32);
+    __m128i a3 = LOAD(data + 48);
+    data += 64;
+    size -= 64;
+
+    while (size >= 64) {
+        a0 = fold(a0, fold_512, LOAD(data));
+        a1 = fold(a1, fold_512, LOAD(data + 16));
+        a2 = fold(a2, fold_512, LOAD(data + 32));
+        a3 = fold(a3, fold_512, LOAD(data + 48));
+        data += 64;
+        size -= 64;
+    }
+
+    __m128i x = fold(a0, fold_384, fold(a1, fold_256, fold(a2, fold_128, a3)));
+    while (size >= 16) {
+        x = fold(x, fold_128, LOAD(data));
+        data += 16;
+        size -= 16;
+    }
+#undef LOAD
+
+    unsigned char folded[16];
+    _mm_storeu_si128((__m128i*)folded, _mm_shuffle_epi8(x, reverse));
+    crc = crc_slice8(0, folded, sizeof(folded));
+    return crc_slice8(crc, data, size);
+}
+#endif
+
+unsigned int ogg_crc_update(unsigned int crc, const unsigned char *data, size_t size) {
+    pthread_once(&crc_once, crc_init);
+#ifdef OGG_CRC_HAVE_PCLMUL
+    if (have_pclmul && size >= FOLD_MIN_SIZE) {
+        return crc_pclmul(crc, data, size);
+    }
+#endif
+    return crc_slice8(crc, data, size);
+}
+
+const char *ogg_crc_kernel(void) {
+    pthread_once(&crc_once, crc_init);
+#ifdef OGG_CRC_HAVE_PCLMUL
+    if (have_pclmul) {
+        return "pclmul";
+    }
+#endif
+    return "slice8";
+}
+
+unsigned int ogg_page_crc(const unsigned char *page, size_t size) {
+    static const unsigned char zero[4] = { 0, 0, 0, 0 };
+    if (size < OGG_CHECKSUM_OFFSET + 4) {
+        return ogg_crc_update(0, page, size);
+    }
+    unsigned int crc = ogg_crc_update(0, page, OGG_CHECKSUM_OFFSET);
+    crc = ogg_crc_update(crc, zero, 4);
+    return ogg_crc_update(crc, page + OGG_CHECKSUM_OFFSET + 4, size - OGG_CHECKSUM_OFFSET - 4);
+}
+
+int ogg_page_crc_ok(const unsigned char *page, size_t size) {
+    if (size < OGG_CHECKSUM_OFFSET + 4) {
+        return 0;
+    }
+    const unsigned char *stored = page + OGG_CHECKSUM_OFFSET;
+    unsigned int expected = (unsigned int)stored[0] | ((unsigned int)stored[1] << 8) |
+                            ((unsigned int)stored[2] << 16) | ((unsigned int)stored[3] << 24);
+    return ogg_page_crc(page, size) == expected;
+}
@@ -1,206 +1,290 @@
 #include "player.h"
 #include "common.h"
-#include "audio_callback.h"
+#include "audio_output.h"
 #include "ogg_reader.h"
+#include "seek_index.h"
+#include "keyboard.h"
 
-int play_ogg_opus(const char *filename) {
-    FILE *fin = fopen(filename, "rb");
-    if (!fin) {
-        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
-        return 1;
+typedef struct {
+    InputSource *in;
+    OggReader *reader;
+    OpusMSDecoder *decoder;
+    AudioOutput *out;
+    const OpusHeadInfo *head;
+    int rate;             // decode rate; output positions count at it
+    SeekIndex index;
+    int have_index;
+} OggSeeker;
+
+// Granule positions count 48 kHz samples, whatever the decode rate
+static long long to_decoded(const OggSeeker *seeker, long long granule) {
+    return granule * seeker->rate / SAMPLE_RATE;
+}
+
+// Repositions so that the next committed frame is the sample at
+// content time seconds. Mapped inputs jump to a page found through the
+// seek index, then decode OPUS_PREROLL_SAMPLES before the target and drop
+// them; other inputs can only decode forward and discard. Audio still
+// queued for the device is dropped.
+static int seek_ogg(OggSeeker *seeker, double seconds) {
+    if (seconds < 0) seconds = 0;
+    long long target = (long long)(seconds * SAMPLE_RATE) + seeker->head->pre_skip;
+    AudioOutput *out = seeker->out;
+
+    if (seeker->have_index) {
+        long long preroll_target = target - OPUS_PREROLL_SAMPLES;
+        SeekPoint point;
+        if (!seek_index_find(&seeker->index, preroll_target < 0 ? 0 : preroll_target, &point) ||
+            !input_seek(seeker->in, point.offset)) {
+            return 0;
+        }
+        audio_output_flush(out);
+        ogg_reader_reset(seeker->reader);
+        opus_multistream_decoder_ctl(seeker->decoder, OPUS_RESET_STATE);
+        audio_output_skip(out, (unsigned long long)(to_decoded(seeker, target) - to_decoded(seeker, point.granule)));
+    } else {
+        // Stream sample the next decoded frame will have
+        long long next = out->timeline_offset + (long long)out->frames_written - (long long)out->skip_frames;
+        if (to_decoded(seeker, target) < next) {
+            return 0;
+        }
+        audio_output_flush(out);
+        audio_output_skip(out, (unsigned long long)(to_decoded(seeker, target) - next));
     }
 
-    OggPageHeader header;
-    unsigned char *packets[256];
-    int packet_sizes[256];
-    int num_packets;
+    audio_output_set_position(out, to_decoded(seeker, target));
+    return 1;
+}
 
-    // Read OpusHead
-    if (read_ogg_page(fin, &header, packets, packet_sizes, &num_packets) <= 0) {
-        fprintf(stderr, "Error: Failed to read OpusHead page\n");
-        fclose(fin);
-        return 1;
+// First page after damaged data was skipped: conceals the missing audio
+// when the page's granule says how much is gone (a bogus or huge gap
+// resets the decoder instead), then realigns the output so end trimming
+// stays exact
+static void bridge_gap(OggSeeker *seeker) {
+    const OggReader *reader = seeker->reader;
+    AudioOutput *out = seeker->out;
+
+    long long page_start = ogg_reader_page_start(reader);
+    if (page_start < 0) {
+        opus_multistream_decoder_ctl(seeker->decoder, OPUS_RESET_STATE);
+        return;
+    }
+    page_start = to_decoded(seeker, page_start);
+
+    // Stream sample the next decoded frame would have had
+    long long next = out->timeline_offset + (long long)out->frames_written - (long long)out->skip_frames;
+    long long gap = page_start - next;
+    if (gap >= 0 && gap <= to_decoded(seeker, OGG_MAX_CONCEAL_SAMPLES)) {
+        player_conceal(seeker->decoder, out, gap);
+    } else {
+        opus_multistream_decoder_ctl(seeker->decoder, OPUS_RESET_STATE);
+    }
+    audio_output_set_position(out, page_start + (long long)out->skip_frames);
+}
+
+static void seeker_index_open(OggSeeker *seeker, const PlayerOptions *options, int link) {
+    InputSource *in = seeker->in;
+    if (in->mapped) {
+        seeker->have_index = seek_index_init(&seeker->index, in->data, in->size, (size_t)input_tell(in),
+                                             seeker->reader->serial);
+        // The sidecar describes the first logical stream
+        if (seeker->have_index && options->seek_index_path && link == 1) {
+            seek_index_load(&seeker->index, options->seek_index_path);
+        }
     }
+}
 
-    int sample_rate, channels;
-    
-    if (!parse_opus_head_ogg(packets[0], packet_sizes[0], &sample_rate, &channels)) {
-        fprintf(stderr, "Error: Invalid OpusHead\n");
-        for (int i = 0; i < num_packets; i++) free(packets[i]);
-        fclose(fin);
+static void seeker_index_close(OggSeeker *seeker, const PlayerOptions *options, int link) {
+    if (seeker->have_index) {
+        if (options->seek_index_path && link == 1) {
+            seek_index_save(&seeker->index, options->seek_index_path);
+        }
+        seek_index_free(&seeker->index);
+        seeker->have_index = 0;
+    }
+}
+
+// Moves on to the next link of a chained file, whose headers are in
+// seeker->head: the decoder is re-initialised in place when it can be, and
+// the output is reopened only if the channel layout changed
+static int start_link(OggSeeker *seeker, const PlayerOptions *options, const OpusHeadInfo *old_head, int link) {
+    const OpusHeadInfo *head = seeker->head;
+
+    seeker_index_close(seeker, options, link - 1);
+
+    int err;
+    seeker->decoder = player_decoder_reconfigure(options, seeker->decoder, seeker->rate, old_head, head, &err);
+    if (!seeker->decoder) {
+        fprintf(stderr, "\nError: Failed to set up decoder for stream %d: %s\n", link, opus_strerror(err));
+        return 0;
+    }
+    if (!player_reformat_output(seeker->out, seeker->rate, head->channels, head->mapping_family)) {
+        return 0;
+    }
+
+    if (!options->quiet) {
+        printf("\n\n--- Chained stream %d: %d channels, %d Hz original ---\n",
+               link, head->channels, head->sample_rate);
+    }
+
+    player_start_stream(seeker->decoder, seeker->out, head->gain, (int)to_decoded(seeker, head->pre_skip));
+    seeker_index_open(seeker, options, link);
+    return 1;
+}
+
+int play_ogg_opus(InputSource *in, const PlayerOptions *options, PlayResult *result) {
+    OggReader reader;
+    if (!ogg_reader_init(&reader, in)) {
+        fprintf(stderr, "Error: Failed to allocate Ogg reader\n");
         return 1;
     }
-    for (int i = 0; i < num_packets; i++) free(packets[i]);
+    reader.crc_mode = options->ogg_crc;
 
-    // Skip OpusTags
-    if (read_ogg_page(fin, &header, packets, packet_sizes, &num_packets) <= 0) {
-        fprintf(stderr, "Error: Failed to read OpusTags page\n");
-        fclose(fin);
+    OpusHeadInfo head;
+    if (!ogg_reader_read_headers(&reader, &head)) {
+        ogg_reader_free(&reader);
         return 1;
     }
-    for (int i = 0; i < num_packets; i++) free(packets[i]);
 
-    int decode_sample_rate = 48000;
-    
-    printf("\n=== Playing Ogg Opus ===\n");
-    printf("Channels: %d\n", channels);
-    printf("Original Sample Rate: %d Hz\n", sample_rate);
-    printf("Decode Sample Rate: %d Hz\n", decode_sample_rate);
-    printf("\nPress Ctrl+C to stop\n\n");
+    int decode_sample_rate = player_decode_rate(options, SAMPLE_RATE);
 
     // Create decoder
     int err;
-    OpusDecoder *decoder = opus_decoder_create(decode_sample_rate, channels, &err);
-    if (err != OPUS_OK) {
+    OpusMSDecoder *decoder = player_decoder_create(options, decode_sample_rate, &head, &err);
+    if (!decoder) {
         fprintf(stderr, "Error: Failed to create decoder: %s\n", opus_strerror(err));
-        fclose(fin);
+        ogg_reader_free(&reader);
         return 1;
     }
 
-    // Initialize PortAudio
-    err = Pa_Initialize();
-    if (err != paNoError) {
-        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
-        opus_decoder_destroy(decoder);
-        fclose(fin);
+    // Open output (device, file or null sink)
+    AudioOutput local;
+    int decode_errors = 0;
+    OutputConfig config = options->output;
+    config.mapping_family = head.mapping_family;
+    AudioOutput *out = player_open_output(options, &local, &config, decode_sample_rate, head.channels);
+    if (!out) {
+        player_decoder_destroy(options, decoder);
+        ogg_reader_free(&reader);
         return 1;
     }
 
-    // Setup audio data
-    AudioData audio_data;
-    audio_data.buffer_size = decode_sample_rate * channels * BUFFER_SIZE_SECONDS;
-    audio_data.pcm_buffer = (short*)calloc(audio_data.buffer_size, sizeof(short));
-    audio_data.read_position = 0;
-    audio_data.write_position = 0;
-    audio_data.channels = channels;
-    audio_data.decoding_finished = 0;
-    audio_data.playback_finished = 0;
-
-    // Open audio stream
-    PaStreamParameters outputParameters;
-    outputParameters.device = Pa_GetDefaultOutputDevice();
-    
-    if (outputParameters.device == paNoDevice) {
-        fprintf(stderr, "Error: No default output device.\n");
-        free(audio_data.pcm_buffer);
-        Pa_Terminate();
-        opus_decoder_destroy(decoder);
-        fclose(fin);
-        return 1;
-    }
-    
-    outputParameters.channelCount = channels;
-    outputParameters.sampleFormat = paInt16;
-    outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
-    outputParameters.hostApiSpecificStreamInfo = NULL;
-
-    printf("Using audio device: %s\n", Pa_GetDeviceInfo(outputParameters.device)->name);
-
-    PaStream *stream;
-    err = Pa_OpenStream(&stream, NULL, &outputParameters, decode_sample_rate,
-                        256, paClipOff, audio_callback, &audio_data);
-    
-    if (err != paNoError) {
-        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
-        free(audio_data.pcm_buffer);
-        Pa_Terminate();
-        opus_decoder_destroy(decoder);
-        fclose(fin);
-        return 1;
+    // After opening, so "-o -" has already moved console output to stderr
+    if (!options->quiet) {
+        if (options->title) {
+            printf("\n%s", options->title);
+        }
+        printf("\n=== Playing Ogg Opus ===\n");
+        printf("Channels: %d\n", head.channels);
+        if (head.mapping_family != 0) {
+            printf("Channel Mapping: family %d, %d streams (%d coupled)\n",
+                   head.mapping_family, head.streams, head.coupled_streams);
+        }
+        printf("Original Sample Rate: %d Hz\n", head.sample_rate);
+        printf("Decode Sample Rate: %d Hz\n", decode_sample_rate);
+        printf("\nPress Ctrl+C to stop\n\n");
     }
 
-    // Start stream
-    err = Pa_StartStream(stream);
-    if (err != paNoError) {
-        fprintf(stderr, "PortAudio start error: %s\n", Pa_GetErrorText(err));
-        Pa_CloseStream(stream);
-        free(audio_data.pcm_buffer);
-        Pa_Terminate();
-        opus_decoder_destroy(decoder);
-        fclose(fin);
-        return 1;
+    // Seeking: random access through the granule index when mapped
+    OggSeeker seeker;
+    memset(&seeker, 0, sizeof(seeker));
+    seeker.in = in;
+    seeker.reader = &reader;
+    seeker.decoder = decoder;
+    seeker.out = out;
+    seeker.head = &head;
+    seeker.rate = decode_sample_rate;
+
+    player_start_stream(decoder, out, head.gain, (int)to_decoded(&seeker, head.pre_skip));
+    seeker_index_open(&seeker, options, 1);
+    int link = 1;
+
+    if (options->start_seconds > 0 && !seek_ogg(&seeker, options->start_seconds)) {
+        fprintf(stderr, "Warning: Cannot seek to %.2f sec\n", options->start_seconds);
     }
-    
-    printf("Audio stream started\n\n");
 
-    short *pcm = (short*)malloc(FRAME_SIZE * channels * sizeof(short));
-    int frame_count = 0;
+    int interactive = options->output.mode == OUTPUT_DEVICE && !options->quiet && keyboard_enable();
+    if (interactive) {
+        printf("Seek: Left/Right arrows or ,/. (%d sec)\n\n", SEEK_STEP_SECONDS);
+    }
 
     // Decode pages
-    while (!stop_playback) {
-        int result = read_ogg_page(fin, &header, packets, packet_sizes, &num_packets);
-        if (result == 0) break;
-        if (result < 0) {
+    while (!audio_output_stopped(out)) {
+        int status = ogg_reader_read_page(&reader);
+        if (status < 0) {
             fprintf(stderr, "Error reading Ogg page\n");
+            decode_errors++;
             break;
         }
 
-        for (int i = 0; i < num_packets; i++) {
-            if (packet_sizes[i] == 0) {
-                free(packets[i]);
-                continue;
+        if (status > 0) {
+            if (reader.discontinuity) {
+                bridge_gap(&seeker);
+            }
+
+            // The last page's granule marks the real end; the encoder padded
+            // its final packet past it
+            if ((reader.header.header_type & 0x04) && reader.header.granule_position != (unsigned long long)-1) {
+                audio_output_set_end(out, to_decoded(&seeker, (long long)reader.header.granule_position));
             }
 
-            int num_samples = opus_decode(decoder, packets[i], packet_sizes[i], 
-                                         pcm, FRAME_SIZE, 0);
-            
-            if (num_samples > 0) {
-                // Wait if buffer is getting too full (keep 5 seconds max buffered)
-                while ((audio_data.write_position - audio_data.read_position) > 
-                       (decode_sample_rate * channels * 5) && !stop_playback) {
-                    Pa_Sleep(10);
+            int seeked = 0;
+            for (int i = 0; i < reader.num_packets && !seeked; i++) {
+                const OggPacket *packet = &reader.packets[i];
+                if (packet->size == 0) {
+                    continue;
                 }
-                
-                // Copy to buffer with circular buffering
-                int samples_to_write = num_samples * channels;
-                for (int j = 0; j < samples_to_write; j++) {
-                    audio_data.pcm_buffer[(audio_data.write_position + j) % audio_data.buffer_size] = pcm[j];
+
+                int num_samples = player_decode(decoder, out, packet->data, packet->size);
+                if (num_samples > 0) {
+                    audio_output_progress(out);
+                } else if (num_samples < 0) {
+                    fprintf(stderr, "\nDecode error: %s\n", opus_strerror(num_samples));
+                    decode_errors++;
                 }
-                audio_data.write_position += samples_to_write;
-                
-                frame_count++;
-                
-                if (frame_count % 50 == 0) {
-                    float decoded_duration = (float)audio_data.write_position / (decode_sample_rate * channels);
-                    int buffered_samples = audio_data.write_position - audio_data.read_position;
-                    float buffered_duration = (float)buffered_samples / (decode_sample_rate * channels);
-                    printf("\rDecoded: %.2f sec | Buffered: %.2f sec | Playing...", 
-                           decoded_duration, buffered_duration);
-                    fflush(stdout);
+
+                int key = interactive ? keyboard_poll() : 0;
+                if (key) {
+                    double now = (double)(audio_output_play_position(out) - to_decoded(&seeker, head.pre_skip)) /
+                                 decode_sample_rate;
+                    double step = (key == KEY_SEEK_FORWARD) ? SEEK_STEP_SECONDS : -SEEK_STEP_SECONDS;
+                    seeked = seek_ogg(&seeker, now + step); // rest of this page is stale
                 }
-            } else if (num_samples < 0) {
-                fprintf(stderr, "\nDecode error: %s\n", opus_strerror(num_samples));
             }
 
-            free(packets[i]);
+            if (seeked || !(reader.header.header_type & 0x04)) continue;
         }
 
-        if (header.header_type & 0x04) break; // EOS
+        // End of this logical stream; a chained file carries on with the next
+        OpusHeadInfo old_head = head;
+        int next = ogg_reader_next_stream(&reader, &head);
+        if (next <= 0) {
+            if (next < 0) decode_errors++;
+            break;
+        }
+        if (!start_link(&seeker, options, &old_head, ++link)) {
+            decode_errors++;
+            break;
+        }
+        decoder = seeker.decoder;
     }
 
-    // Mark decoding as finished
-    audio_data.decoding_finished = 1;
-    printf("\n\nDecoding finished, waiting for playback to complete...\n");
-    
-    // Wait for playback to finish
-    while (!audio_data.playback_finished && !stop_playback) {
-        Pa_Sleep(100);
-        int remaining = audio_data.write_position - audio_data.read_position;
-        if (remaining > 0) {
-            printf("\rRemaining: %.2f seconds", (float)remaining / (decode_sample_rate * channels));
-            fflush(stdout);
-        }
+    if (interactive) {
+        keyboard_restore();
     }
 
-    printf("\n✓ Playback finished\n");
+    // A failed reopen leaves no output to finish
+    if (out->channels) {
+        player_finish(options, out, in, decode_errors, result);
+    }
+    player_report_damage(options, &reader.damage, result);
+    seeker_index_close(&seeker, options, link);
 
-    Pa_StopStream(stream);
-    Pa_CloseStream(stream);
-    Pa_Terminate();
-    free(pcm);
-    free(audio_data.pcm_buffer);
-    opus_decoder_destroy(decoder);
-    fclose(fin);
+    if (out->channels) {
+        player_close_output(options, out);
+    }
+    player_decoder_destroy(options, seeker.decoder);
+    ogg_reader_free(&reader);
 
     return 0;
 }
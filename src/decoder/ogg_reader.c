@@ -1,60 +1,368 @@
 #include "ogg_reader.h"
 #include "packet_buffer.h"
+#include "ogg_crc.h"
 
-int read_ogg_page(FILE *fin, OggPageHeader *header, unsigned char **packets, 
-                  int *packet_sizes, int *num_packets) {
-    if (fread(header, 27, 1, fin) != 1) {
+// Bytes searched per memchr() call while resynchronising
+#define OGG_RESYNC_SCAN 4096
+
+int ogg_reader_init(OggReader *reader, InputSource *in) {
+    reader->in = in;
+    reader->segments = NULL;
+    reader->payload = NULL;
+    packet_buffer_init(&reader->partial);
+    if (!reader->partial.data) {
         return 0;
     }
+    reader->has_partial = 0;
+    reader->tail = NULL;
+    reader->tail_size = 0;
+    reader->num_packets = 0;
+    reader->serial = 0;
+    reader->locked = 0;
+    reader->in_data = 0;
+    reader->crc_mode = OGG_CRC_OFF;
+    memset(&reader->damage, 0, sizeof(reader->damage));
+    reader->discontinuity = 0;
+    reader->page_offset = 0;
+    return 1;
+}
 
-    if (memcmp(header->capture_pattern, "OggS", 4) != 0) {
-        return -1;
+void ogg_reader_free(OggReader *reader) {
+    packet_buffer_free(&reader->partial);
+    reader->partial.data = NULL;
+}
+
+// Drops any half-assembled packet, e.g. after the input was repositioned
+void ogg_reader_reset(OggReader *reader) {
+    packet_buffer_reset(&reader->partial);
+    reader->has_partial = 0;
+    reader->tail = NULL;
+    reader->tail_size = 0;
+    reader->num_packets = 0;
+    reader->discontinuity = 0;
+}
+
+// 1 if a complete page whose checksum matches starts at the read position,
+// -1 if a complete page with a bad checksum does, 0 if there is no page
+static int page_at(InputSource *in) {
+    const unsigned char *page;
+    if (input_peek(in, 27, &page) < 27 || memcmp(page, "OggS", 4) != 0 || page[4] != 0) {
+        return 0;
     }
+    size_t header_size = 27 + page[26];
+    size_t page_size;
+    if (input_peek(in, header_size, &page) != header_size ||
+        ogg_page_size(page, header_size, &page_size) < 0 ||
+        input_peek(in, page_size, &page) != page_size) {
+        return 0;
+    }
+    return ogg_page_crc_ok(page, page_size) ? 1 : -1;
+}
 
-    unsigned char segments[255];
-    if (fread(segments, 1, header->page_segments, fin) != header->page_segments) {
-        return -1;
+// Moves past damaged data to the next page that parses and passes its CRC,
+// whatever the verification mode, so a stray "OggS" in the damage is not
+// taken for a page. Returns 1 positioned on it, 0 if the input ends first.
+static int resync(OggReader *reader) {
+    InputSource *in = reader->in;
+    unsigned long long start = input_tell(in);
+    reader->damage.resyncs++;
+    input_skip(in, 1);
+
+    int found = 0;
+    while (!found) {
+        const unsigned char *window;
+        size_t available = input_peek(in, OGG_RESYNC_SCAN, &window);
+        if (available < 27) {
+            input_skip(in, available);
+            break;
+        }
+
+        // Candidates need their whole fixed header inside the window
+        size_t limit = available - 26;
+        const unsigned char *hit = (const unsigned char*)memchr(window, 'O', limit);
+        if (!hit) {
+            input_skip(in, limit);
+            continue;
+        }
+        input_skip(in, (size_t)(hit - window));
+        int status = page_at(in);
+        if (status < 0) {
+            reader->damage.bad_pages++;
+        }
+        found = status > 0;
+        if (!found) {
+            input_skip(in, 1);
+        }
     }
 
+    reader->damage.skipped_bytes += input_tell(in) - start;
+    return found;
+}
+
+// Returns 1 on success, 0 at the end of the file or of the locked logical
+// stream, -1 on damaged data in strict mode. Otherwise damage (a bad
+// capture pattern, a truncated page, a bad checksum when verifying) is
+// skipped up to the next good page and reader->discontinuity is set.
+// Completed packets are exposed in reader->packets as views into the input
+// window; only packets that cross a page boundary are copied, into
+// reader->partial.
+int ogg_reader_read_page(OggReader *reader) {
+    OggPageHeader *header = &reader->header;
+
+    // The previous page's unfinished packet lives in the input window, which
+    // the next peek may slide, so move it into the reassembly buffer first
+    if (reader->tail) {
+        packet_buffer_reset(&reader->partial);
+        packet_buffer_append(&reader->partial, reader->tail, reader->tail_size);
+        reader->has_partial = 1;
+        reader->tail = NULL;
+        reader->tail_size = 0;
+    }
+    reader->num_packets = 0;
+    reader->discontinuity = 0;
+
+    InputSource *in = reader->in;
+    const unsigned char *page;
+    size_t header_size = 0;
+    size_t page_size = 0;
     int payload_size = 0;
-    for (int i = 0; i < header->page_segments; i++) {
-        payload_size += segments[i];
+
+    for (;;) {
+        size_t got = input_peek(in, 27, &page);
+        if (got == 0) {
+            return 0;
+        }
+
+        int damaged = got < 27 || memcmp(page, "OggS", 4) != 0;
+        if (!damaged) {
+            memcpy(header, page, 27);
+            header_size = 27 + header->page_segments;
+            damaged = input_peek(in, header_size, &page) != header_size;
+        }
+        if (!damaged) {
+            payload_size = 0;
+            for (int i = 0; i < header->page_segments; i++) {
+                payload_size += page[27 + i];
+            }
+            page_size = header_size + payload_size;
+            damaged = input_peek(in, page_size, &page) != page_size;
+        }
+
+        int ours = !damaged && (!reader->locked || header->serial_number == reader->serial);
+        int bad_crc = ours && reader->crc_mode != OGG_CRC_OFF && !ogg_page_crc_ok(page, page_size);
+        if (bad_crc) {
+            reader->damage.bad_pages++;
+        }
+
+        if (damaged || bad_crc) {
+            if (reader->crc_mode == OGG_CRC_STRICT) {
+                fprintf(stderr, "\nError: %s at offset %llu\n",
+                        bad_crc ? "Ogg page CRC mismatch" : "Damaged Ogg page", input_tell(in));
+                return -1;
+            }
+
+            // Whatever was being assembled is lost with the damaged bytes
+            packet_buffer_reset(&reader->partial);
+            reader->has_partial = 0;
+            reader->discontinuity = 1;
+            if (!resync(reader)) {
+                return 0;
+            }
+            continue;
+        }
+
+        if (ours) {
+            if (reader->locked && !(header->header_type & 0x02)) {
+                reader->in_data = 1;
+            }
+            reader->page_offset = input_tell(in);
+            input_skip(in, page_size);
+            break;
+        }
+
+        // BOS pages all come before any data within one link, so a late
+        // one starts the next link; leave it for ogg_reader_next_stream()
+        if ((header->header_type & 0x02) && reader->in_data) {
+            return 0;
+        }
+        input_skip(in, page_size);
     }
+    reader->segments = page + 27;
+    reader->payload = page + header_size;
 
-    unsigned char *payload = (unsigned char*)malloc(payload_size);
-    if (fread(payload, 1, payload_size, fin) != (size_t)payload_size) {
-        free(payload);
-        return -1;
+    // A continued packet only makes sense if we hold its beginning
+    int continued = (header->header_type & 0x01) && reader->has_partial;
+    int skip_leading = (header->header_type & 0x01) && !reader->has_partial;
+    if (!continued) {
+        packet_buffer_reset(&reader->partial);
+        reader->has_partial = 0;
     }
 
-    *num_packets = 0;
     int pos = 0;
-    PacketBuffer current_packet;
-    packet_buffer_init(&current_packet);
-
+    int start = 0;
     for (int i = 0; i < header->page_segments; i++) {
-        packet_buffer_append(&current_packet, payload + pos, segments[i]);
-        pos += segments[i];
+        pos += reader->segments[i];
+        if (reader->segments[i] == 255) {
+            continue;
+        }
+
+        if (skip_leading) {
+            skip_leading = 0;
+        } else if (continued) {
+            packet_buffer_append(&reader->partial, reader->payload + start, pos - start);
+            reader->packets[reader->num_packets].data = reader->partial.data;
+            reader->packets[reader->num_packets].size = reader->partial.size;
+            reader->num_packets++;
+            reader->has_partial = 0;
+            continued = 0;
+        } else {
+            reader->packets[reader->num_packets].data = reader->payload + start;
+            reader->packets[reader->num_packets].size = pos - start;
+            reader->num_packets++;
+        }
+        start = pos;
+    }
 
-        if (segments[i] < 255) {
-            packets[*num_packets] = (unsigned char*)malloc(current_packet.size);
-            memcpy(packets[*num_packets], current_packet.data, current_packet.size);
-            packet_sizes[*num_packets] = current_packet.size;
-            (*num_packets)++;
-            packet_buffer_reset(&current_packet);
+    // Bytes after the last terminating segment belong to a packet that
+    // continues on the next page
+    if (start < payload_size && !skip_leading) {
+        if (continued) {
+            packet_buffer_append(&reader->partial, reader->payload + start, payload_size - start);
+        } else {
+            reader->tail = reader->payload + start;
+            reader->tail_size = payload_size - start;
         }
     }
 
-    packet_buffer_free(&current_packet);
-    free(payload);
     return 1;
 }
 
-int parse_opus_head_ogg(unsigned char *packet, int size, int *sample_rate, int *channels) {
+int ogg_reader_next_stream(OggReader *reader, OpusHeadInfo *info) {
+    ogg_reader_reset(reader);
+    reader->locked = 0;
+    reader->in_data = 0;
+
+    // Other logical streams' headers and pages (non-Opus links, or streams
+    // multiplexed alongside) are skipped until an Opus BOS page turns up
+    for (;;) {
+        int status = ogg_reader_read_page(reader);
+        if (status <= 0) {
+            return status;
+        }
+        if ((reader->header.header_type & 0x02) && reader->num_packets >= 1 &&
+            parse_opus_head_ogg(reader->packets[0].data, reader->packets[0].size, info)) {
+            break;
+        }
+    }
+
+    reader->serial = reader->header.serial_number;
+    reader->locked = 1;
+
+    // Skip OpusTags
+    do {
+        if (ogg_reader_read_page(reader) <= 0) {
+            fprintf(stderr, "Error: Failed to read OpusTags page\n");
+            return -1;
+        }
+    } while (reader->num_packets == 0);
+
+    return 1;
+}
+
+// Reads OpusHead and skips OpusTags (which may span several pages),
+// leaving the reader at the first audio page
+int ogg_reader_read_headers(OggReader *reader, OpusHeadInfo *info) {
+    int status = ogg_reader_next_stream(reader, info);
+    if (status == 0) {
+        fprintf(stderr, "Error: No Opus stream found\n");
+    }
+    return status > 0;
+}
+
+long long ogg_reader_page_start(const OggReader *reader) {
+    long long granule = (long long)reader->header.granule_position;
+    if (granule < 0) {
+        return -1;
+    }
+    for (int i = 0; i < reader->num_packets; i++) {
+        int n = opus_packet_get_nb_samples(reader->packets[i].data, reader->packets[i].size, SAMPLE_RATE);
+        if (n > 0) granule -= n;
+    }
+    return granule;
+}
+
+// Size of the page starting at data without reading it: 1 if the whole
+// page is within available bytes, 0 if it is truncated, -1 if data does
+// not start with a capture pattern
+int ogg_page_size(const unsigned char *data, size_t available, size_t *page_size) {
+    if (available < 4 || memcmp(data, "OggS", 4) != 0) {
+        return (available < 4) ? 0 : -1;
+    }
+    if (available < 27) {
+        return 0;
+    }
+
+    int num_segments = data[26];
+    if (available < 27 + (size_t)num_segments) {
+        return 0;
+    }
+
+    size_t size = 27 + num_segments;
+    for (int i = 0; i < num_segments; i++) {
+        size += data[27 + i];
+    }
+
+    *page_size = size;
+    return (size <= available) ? 1 : 0;
+}
+
+int parse_opus_head_ogg(const unsigned char *packet, int size, OpusHeadInfo *info) {
     if (size < 19 || memcmp(packet, "OpusHead", 8) != 0) {
         return 0;
     }
-    *channels = packet[9];
-    *sample_rate = packet[12] | (packet[13] << 8) | (packet[14] << 16) | (packet[15] << 24);
+    info->channels = packet[9];
+    info->pre_skip = packet[10] | (packet[11] << 8);
+    info->sample_rate = packet[12] | (packet[13] << 8) | (packet[14] << 16) | (packet[15] << 24);
+    info->gain = (short)(packet[16] | (packet[17] << 8));
+    info->mapping_family = packet[18];
+    if (info->channels == 0) {
+        return 0;
+    }
+
+    if (info->mapping_family == 0) {
+        if (info->channels > 2) return 0;
+        opus_head_default_mapping(info, info->channels);
+        return 1;
+    }
+
+    // Family 3 carries a demixing matrix that the multistream decoder
+    // does not apply
+    if (info->mapping_family == 3) {
+        fprintf(stderr, "Error: Unsupported channel mapping family %d\n", info->mapping_family);
+        return 0;
+    }
+    if (size < 21 + info->channels) {
+        return 0;
+    }
+    info->streams = packet[19];
+    info->coupled_streams = packet[20];
+    if (info->streams == 0 || info->coupled_streams > info->streams ||
+        info->streams + info->coupled_streams > OPUS_HEAD_MAX_CHANNELS) {
+        return 0;
+    }
+    for (int i = 0; i < info->channels; i++) {
+        int index = packet[21 + i];
+        if (index != 255 && index >= info->streams + info->coupled_streams) {
+            return 0;
+        }
+        info->mapping[i] = (unsigned char)index;
+    }
     return 1;
 }
+
+void opus_head_default_mapping(OpusHeadInfo *info, int channels) {
+    info->streams = 1;
+    info->coupled_streams = (channels == 2);
+    info->mapping[0] = 0;
+    info->mapping[1] = 1;
+}
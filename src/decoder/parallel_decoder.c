@@ -0,0 +1,528 @@
+#include "parallel_decoder.h"
+#include "common.h"
+#include "audio_output.h"
+#include "ogg_reader.h"
+#include "realtime.h"
+#include <pthread.h>
+
+typedef struct {
+    size_t offset;
+    long long granule;    // end granule, carried forward over pages with none
+    int continued;        // first packet began on the previous page
+} PageEntry;
+
+typedef struct {
+    size_t preroll_offset;  // first page decoded
+    size_t start_offset;    // first page whose output is kept
+    size_t end_offset;      // one past the last page
+    long long start_granule;  // stream sample of the first kept frame
+    long long expected_frames;
+    short *pcm;
+    size_t frames;
+    size_t capacity;
+    unsigned long long packets;
+    int decode_errors;
+    OggDamage damage;     // skipped pages, pre-roll excluded
+    int done;
+} Chunk;
+
+typedef struct {
+    const unsigned char *data;
+    int sample_rate;
+    int channels;
+    const OpusHeadInfo *head;  // channel mapping for the multistream decoder
+    int gain;             // header output gain, Q7.8 dB (int16 path)
+    int use_float;        // decode to float and convert with scale
+    float scale;
+    int dither;
+    int verify_crc;       // skip and count pages with a bad checksum
+    Chunk *chunks;
+    int num_chunks;
+    int next_chunk;
+    int written;
+    int max_in_flight;
+    int cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ParallelJob;
+
+static int append_pcm(Chunk *chunk, const short *pcm, int frames, int channels) {
+    if (chunk->frames + frames > chunk->capacity) {
+        size_t capacity = chunk->capacity ? chunk->capacity * 2 : FRAME_SIZE * 16;
+        while (capacity < chunk->frames + frames) capacity *= 2;
+        short *grown = (short*)realloc(chunk->pcm, capacity * channels * sizeof(short));
+        if (!grown) return 0;
+        chunk->pcm = grown;
+        chunk->capacity = capacity;
+    }
+    memcpy(chunk->pcm + chunk->frames * channels, pcm, (size_t)frames * channels * sizeof(short));
+    chunk->frames += frames;
+    return 1;
+}
+
+// What the reader records for the pages in [from, to): a run of pages
+// with bad checksums is one resync. Framing inside a chunk is intact (see
+// index_pages()), so the pages can be walked by their sizes.
+static void count_damage(const unsigned char *data, size_t from, size_t to, OggDamage *damage) {
+    memset(damage, 0, sizeof(*damage));
+    int in_run = 0;
+    size_t page_size;
+    while (from < to && ogg_page_size(data + from, to - from, &page_size) == 1) {
+        int bad = !ogg_page_crc_ok(data + from, page_size);
+        if (bad) {
+            damage->bad_pages++;
+            damage->skipped_bytes += page_size;
+            damage->resyncs += !in_run;
+        }
+        in_run = bad;
+        from += page_size;
+    }
+}
+
+typedef struct {
+    OpusMSDecoder *decoder;
+    short *pcm;
+    float *fpcm;
+    PcmDither *dither;
+} ChunkDecoder;
+
+// Decodes one packet (or, with data NULL, frame_size samples of
+// concealment) into dec->pcm
+static int decode_packet(ParallelJob *job, ChunkDecoder *dec, const unsigned char *data, int size, int frame_size) {
+    int num_samples;
+    if (job->use_float) {
+        num_samples = opus_multistream_decode_float(dec->decoder, data, size, dec->fpcm, frame_size, 0);
+        if (num_samples > 0) {
+            pcm_float_to_s16(dec->fpcm, dec->pcm, (size_t)num_samples * job->channels, job->scale, dec->dither);
+        }
+    } else {
+        num_samples = opus_multistream_decode(dec->decoder, data, size, dec->pcm, frame_size, 0);
+    }
+    return num_samples;
+}
+
+// Same as bridge_gap() in the serial player: fills the audio lost to
+// damaged data up to page_start (the first sample after it), or resets the
+// decoder when the gap is unknown or implausible
+static void bridge_chunk_gap(ParallelJob *job, Chunk *chunk, ChunkDecoder *dec, long long page_start,
+                             int keep, long long next) {
+    long long gap = page_start - next;
+    if (!keep || page_start < 0 || gap < 0 || gap > OGG_MAX_CONCEAL_SAMPLES) {
+        opus_multistream_decoder_ctl(dec->decoder, OPUS_RESET_STATE);
+        return;
+    }
+    while (gap > 0) {
+        int frame_size = gap > FRAME_SIZE ? FRAME_SIZE : (int)gap;
+        frame_size -= frame_size % (SAMPLE_RATE / 400);
+        if (frame_size == 0) break;
+        int num_samples = decode_packet(job, dec, NULL, 0, frame_size);
+        if (num_samples <= 0 || !append_pcm(chunk, dec->pcm, num_samples, job->channels)) break;
+        gap -= num_samples;
+    }
+}
+
+static void decode_chunk(ParallelJob *job, Chunk *chunk, ChunkDecoder *dec) {
+    OpusMSDecoder *decoder = dec->decoder;
+    short *pcm = dec->pcm;
+    InputSource view;
+    OggReader reader;
+    input_open_memory(&view, job->data + chunk->preroll_offset, chunk->end_offset - chunk->preroll_offset);
+    if (!ogg_reader_init(&reader, &view)) {
+        chunk->decode_errors++;
+        return;
+    }
+    // Strict mode is enforced by the stitcher, so it stops at the first
+    // bad page in file order
+    reader.crc_mode = job->verify_crc ? OGG_CRC_CHECK : OGG_CRC_OFF;
+
+    opus_multistream_decoder_ctl(decoder, OPUS_RESET_STATE);
+    if (!job->use_float && job->gain != 0) {
+        opus_multistream_decoder_ctl(decoder, OPUS_SET_GAIN(job->gain));
+    }
+    if (dec->dither) {
+        // Restart the noise per chunk so output does not depend on scheduling
+        dec->dither->pos = 0;
+    }
+
+    if (chunk->expected_frames > 0) {
+        chunk->capacity = (size_t)chunk->expected_frames + FRAME_SIZE;
+        chunk->pcm = (short*)malloc(chunk->capacity * job->channels * sizeof(short));
+        if (!chunk->pcm) chunk->capacity = 0;
+    }
+
+    size_t keep_from = chunk->start_offset - chunk->preroll_offset;
+    long long next = chunk->start_granule;
+    while (!stop_playback) {
+        int status = ogg_reader_read_page(&reader);
+        if (status == 0) break;
+        if (status < 0) {
+            chunk->decode_errors++;
+            break;
+        }
+        int keep = reader.page_offset >= keep_from;
+        if (reader.discontinuity) {
+            size_t before = chunk->frames;
+            bridge_chunk_gap(job, chunk, dec, ogg_reader_page_start(&reader), keep, next);
+            next += (long long)(chunk->frames - before);
+        }
+
+        for (int i = 0; i < reader.num_packets; i++) {
+            const OggPacket *packet = &reader.packets[i];
+            if (packet->size == 0) continue;
+
+            int num_samples = decode_packet(job, dec, packet->data, packet->size, FRAME_SIZE);
+            if (num_samples < 0) {
+                // A pre-roll packet is counted by the chunk that keeps it
+                if (keep) chunk->decode_errors++;
+                continue;
+            }
+            if (keep) {
+                if (!append_pcm(chunk, pcm, num_samples, job->channels)) {
+                    chunk->decode_errors++;
+                    break;
+                }
+                chunk->packets++;
+                next += num_samples;
+            }
+        }
+    }
+
+    // Damage running up to the end of the chunk: the serial player bridges
+    // it from the next chunk's first page, which starts at this chunk's end
+    if (reader.discontinuity && !stop_playback && chunk != &job->chunks[job->num_chunks - 1]) {
+        bridge_chunk_gap(job, chunk, dec, chunk->start_granule + chunk->expected_frames, 1, next);
+    }
+
+    // The previous chunk has already counted its pages used as pre-roll here
+    chunk->damage = reader.damage;
+    if (job->verify_crc) {
+        OggDamage preroll;
+        count_damage(job->data, chunk->preroll_offset, chunk->start_offset, &preroll);
+        chunk->damage.bad_pages -= preroll.bad_pages;
+        chunk->damage.resyncs -= preroll.resyncs;
+        chunk->damage.skipped_bytes -= preroll.skipped_bytes;
+    }
+    ogg_reader_free(&reader);
+}
+
+static void *parallel_worker(void *arg) {
+    ParallelJob *job = (ParallelJob*)arg;
+
+    int err;
+    ChunkDecoder dec;
+    memset(&dec, 0, sizeof(dec));
+    const OpusHeadInfo *head = job->head;
+    dec.decoder = opus_multistream_decoder_create(job->sample_rate, head->channels, head->streams,
+                                                  head->coupled_streams, head->mapping, &err);
+    dec.pcm = (short*)malloc(FRAME_SIZE * job->channels * sizeof(short));
+    int ready = dec.decoder && dec.pcm;
+    if (job->use_float) {
+        dec.fpcm = (float*)malloc(FRAME_SIZE * job->channels * sizeof(float));
+        ready = ready && dec.fpcm;
+    }
+    if (job->dither) {
+        dec.dither = (PcmDither*)malloc(sizeof(PcmDither));
+        if (dec.dither) pcm_dither_init(dec.dither, 1);
+        ready = ready && dec.dither;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        // Bound decoded-but-unwritten PCM to a few chunks per worker
+        while (!job->cancelled && job->next_chunk < job->num_chunks &&
+               job->next_chunk >= job->written + job->max_in_flight) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
+        if (job->cancelled || job->next_chunk >= job->num_chunks) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        Chunk *chunk = &job->chunks[job->next_chunk++];
+        pthread_mutex_unlock(&job->lock);
+
+        if (ready) {
+            decode_chunk(job, chunk, &dec);
+        } else {
+            chunk->decode_errors++;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    if (dec.decoder) opus_multistream_decoder_destroy(dec.decoder);
+    free(dec.pcm);
+    free(dec.fpcm);
+    free(dec.dither);
+    return NULL;
+}
+
+// Index every audio page from first_offset up to EOS or the end of the
+// mapping; *end_offset is set just past the last indexed page. Stops at a
+// page of another logical stream or at broken framing, and clears
+// *splittable.
+static PageEntry *index_pages(const unsigned char *data, size_t size, size_t first_offset,
+                              unsigned int serial, int *num_pages, size_t *end_offset, int *splittable) {
+    int capacity = 1024;
+    int count = 0;
+    PageEntry *pages = (PageEntry*)malloc(capacity * sizeof(PageEntry));
+    long long granule = 0;
+
+    size_t offset = first_offset;
+    size_t page_size;
+    int eos = 0;
+    while (pages && ogg_page_size(data + offset, size - offset, &page_size) == 1) {
+        if (count == capacity) {
+            capacity *= 2;
+            PageEntry *grown = (PageEntry*)realloc(pages, capacity * sizeof(PageEntry));
+            if (!grown) break;
+            pages = grown;
+        }
+
+        OggPageHeader header;
+        memcpy(&header, data + offset, 27);
+        if (header.serial_number != serial) {
+            *splittable = 0;
+            break;
+        }
+        if ((long long)header.granule_position != -1) {
+            granule = (long long)header.granule_position;
+        }
+
+        pages[count].offset = offset;
+        pages[count].granule = granule;
+        pages[count].continued = header.header_type & 0x01;
+        count++;
+
+        offset += page_size;
+        if (header.header_type & 0x04) { // EOS
+            eos = 1;
+            break;
+        }
+    }
+
+    // Anything after the EOS page is another link of a chained file;
+    // anything else left over is damage the reader has to resync past
+    if (eos ? (offset + 27 <= size && memcmp(data + offset, "OggS", 4) == 0) : offset < size) {
+        *splittable = 0;
+    }
+
+    *num_pages = count;
+    *end_offset = offset;
+    return pages;
+}
+
+// Splits pages into chunks of roughly PARALLEL_CHUNK_SECONDS. Boundaries
+// land only on pages that start a fresh packet, so no packet straddles two
+// chunks; each chunk except the first decodes preroll pages before its
+// start and discards their output.
+static Chunk *plan_chunks(const PageEntry *pages, int num_pages, size_t end_offset, int *num_chunks) {
+    const long long chunk_frames = (long long)SAMPLE_RATE * PARALLEL_CHUNK_SECONDS;
+    int capacity = 16;
+    int count = 0;
+    Chunk *chunks = (Chunk*)calloc(capacity, sizeof(Chunk));
+
+    int start = 0;
+    while (chunks && start < num_pages) {
+        long long base = (start > 0) ? pages[start - 1].granule : 0;
+        int end = start + 1;
+        while (end < num_pages && (pages[end - 1].granule - base < chunk_frames || pages[end].continued)) {
+            end++;
+        }
+
+        int preroll = start;
+        if (start > 0) {
+            while (preroll > 0 && pages[start - 1].granule - pages[preroll - 1].granule < OPUS_PREROLL_SAMPLES) {
+                preroll--;
+            }
+            while (preroll > 0 && pages[preroll].continued) {
+                preroll--;
+            }
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            Chunk *grown = (Chunk*)realloc(chunks, capacity * sizeof(Chunk));
+            if (!grown) break;
+            chunks = grown;
+            memset(chunks + count, 0, (capacity - count) * sizeof(Chunk));
+        }
+
+        Chunk *chunk = &chunks[count++];
+        chunk->preroll_offset = pages[preroll].offset;
+        chunk->start_offset = pages[start].offset;
+        chunk->end_offset = (end < num_pages) ? pages[end].offset : end_offset;
+        chunk->start_granule = (start > 0) ? pages[start - 1].granule : 0;
+        chunk->expected_frames = pages[end - 1].granule - chunk->start_granule;
+        start = end;
+    }
+
+    *num_chunks = count;
+    return chunks;
+}
+
+int decode_ogg_parallel(InputSource *in, const PlayerOptions *options, int jobs, PlayResult *result) {
+    if (!in->mapped || jobs < 2 || options->output.mode == OUTPUT_DEVICE) {
+        return play_ogg_opus(in, options, result);
+    }
+
+    OggReader reader;
+    if (!ogg_reader_init(&reader, in)) {
+        fprintf(stderr, "Error: Failed to allocate Ogg reader\n");
+        return 1;
+    }
+    reader.crc_mode = options->ogg_crc;
+
+    OpusHeadInfo head;
+    if (!ogg_reader_read_headers(&reader, &head)) {
+        ogg_reader_free(&reader);
+        return 1;
+    }
+    unsigned int serial = reader.serial;
+    ogg_reader_free(&reader);
+
+    // The tags page has been consumed; the audio starts here
+    size_t first_offset = (size_t)input_tell(in);
+
+    int num_pages;
+    size_t end_offset;
+    int splittable = 1;
+    PageEntry *pages = index_pages(in->data, in->size, first_offset, serial, &num_pages, &end_offset, &splittable);
+
+    // Chunks assume one logical stream with intact framing; chained,
+    // multiplexed or damaged files take the serial path from the start
+    if (pages && !splittable) {
+        free(pages);
+        input_seek(in, 0);
+        return play_ogg_opus(in, options, result);
+    }
+
+    if (!pages || num_pages == 0) {
+        free(pages);
+        fprintf(stderr, "Error: No audio pages found\n");
+        return 1;
+    }
+
+    // An EOS page's granule trims the encoder's padding from the end
+    OggPageHeader last;
+    memcpy(&last, in->data + pages[num_pages - 1].offset, 27);
+    long long end_granule = (last.header_type & 0x04) ? pages[num_pages - 1].granule : -1;
+
+    ParallelJob job;
+    memset(&job, 0, sizeof(job));
+    job.data = in->data;
+    job.sample_rate = SAMPLE_RATE;
+    job.channels = head.channels;
+    job.head = &head;
+    job.chunks = plan_chunks(pages, num_pages, end_offset, &job.num_chunks);
+    free(pages);
+    if (!job.chunks) {
+        fprintf(stderr, "Error: Failed to plan parallel decode\n");
+        return 1;
+    }
+    job.max_in_flight = jobs * 2;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    AudioOutput out;
+    if (!audio_output_open(&out, &options->output, SAMPLE_RATE, head.channels)) {
+        free(job.chunks);
+        return 1;
+    }
+
+    // Workers convert with the output's settings; the stitcher drops pre-skip
+    audio_output_set_gain(&out, head.gain);
+    job.gain = head.gain;
+    job.use_float = out.use_float;
+    job.scale = out.scale;
+    job.dither = options->output.dither;
+    job.verify_crc = options->ogg_crc != OGG_CRC_OFF;
+    audio_output_skip(&out, head.pre_skip);
+    audio_output_set_position(&out, head.pre_skip);
+    audio_output_set_end(&out, end_granule);
+
+    // After opening, so "-o -" has already moved console output to stderr
+    if (!options->quiet) {
+        printf("\n=== Decoding Ogg Opus (parallel) ===\n");
+        printf("Channels: %d\n", head.channels);
+        if (head.mapping_family != 0) {
+            printf("Channel Mapping: family %d, %d streams (%d coupled)\n",
+                   head.mapping_family, head.streams, head.coupled_streams);
+        }
+        printf("Original Sample Rate: %d Hz\n", head.sample_rate);
+        printf("Decode Sample Rate: %d Hz\n", SAMPLE_RATE);
+        printf("Chunks: %d on %d threads\n\n", job.num_chunks, jobs);
+    }
+
+    pthread_t *threads = (pthread_t*)malloc(jobs * sizeof(pthread_t));
+    int started = 0;
+    realtime_suspend();
+    for (int i = 0; threads && i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, parallel_worker, &job) != 0) break;
+        started++;
+    }
+    realtime_resume();
+    if (started == 0) {
+        // No threads available: decode every chunk on this one
+        job.max_in_flight = job.num_chunks;
+        parallel_worker(&job);
+    }
+
+    // Stitch finished chunks into the output strictly in file order
+    int decode_errors = 0;
+    OggDamage damage;
+    memset(&damage, 0, sizeof(damage));
+    for (int i = 0; i < job.num_chunks; i++) {
+        Chunk *chunk = &job.chunks[i];
+
+        pthread_mutex_lock(&job.lock);
+        while (!chunk->done) {
+            pthread_cond_wait(&job.cond, &job.lock);
+        }
+        pthread_mutex_unlock(&job.lock);
+
+        int rejected = chunk->damage.bad_pages > 0 && options->ogg_crc == OGG_CRC_STRICT;
+        if (rejected) {
+            fprintf(stderr, "\nError: Ogg page CRC mismatch between offsets %zu and %zu\n",
+                    chunk->start_offset, chunk->end_offset);
+            decode_errors++;
+        } else {
+            audio_output_write(&out, chunk->pcm, chunk->frames, chunk->packets);
+        }
+        decode_errors += chunk->decode_errors;
+        damage.bad_pages += chunk->damage.bad_pages;
+        damage.resyncs += chunk->damage.resyncs;
+        damage.skipped_bytes += chunk->damage.skipped_bytes;
+        free(chunk->pcm);
+        chunk->pcm = NULL;
+
+        pthread_mutex_lock(&job.lock);
+        job.written++;
+        if (stop_playback || rejected) job.cancelled = 1;
+        pthread_cond_broadcast(&job.cond);
+        pthread_mutex_unlock(&job.lock);
+
+        if (job.cancelled) break;
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < job.num_chunks; i++) {
+        free(job.chunks[i].pcm);
+    }
+
+    // Everything up to the last indexed page has been consumed
+    input_skip(in, end_offset - first_offset);
+    player_finish(options, &out, in, decode_errors, result);
+    player_report_damage(options, &damage, result);
+    audio_output_close(&out);
+
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.lock);
+    free(threads);
+    free(job.chunks);
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include "player.h"
+#include "common.h"
+#include "timer.h"
+#include "audio_backend.h"
+
+// Rates the Opus decoder can produce directly
+static int opus_rate_supported(int rate) {
+    return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000;
+}
+
+int player_decode_rate(const PlayerOptions *options, int stream_rate) {
+    if (options->output.mode == OUTPUT_DEVICE) {
+        int device_rate = options->output.device_rate > 0 ? options->output.device_rate
+                                                          : audio_backend_device_rate();
+        if (opus_rate_supported(device_rate)) {
+            return device_rate;
+        }
+    }
+    return opus_rate_supported(stream_rate) ? stream_rate : SAMPLE_RATE;
+}
+
+// Re-initialises the caller's decoder when one is supplied and the stream
+// fits it (batch workers keep one per thread), otherwise creates a fresh one
+OpusMSDecoder *player_decoder_create(const PlayerOptions *options, int sample_rate, const OpusHeadInfo *head,
+                                     int *error) {
+    if (options->decoder && head->streams == 1) {
+        *error = opus_multistream_decoder_init(options->decoder, sample_rate, head->channels, head->streams,
+                                               head->coupled_streams, head->mapping);
+        return (*error == OPUS_OK) ? options->decoder : NULL;
+    }
+    return opus_multistream_decoder_create(sample_rate, head->channels, head->streams, head->coupled_streams,
+                                           head->mapping, error);
+}
+
+void player_decoder_destroy(const PlayerOptions *options, OpusMSDecoder *decoder) {
+    if (decoder && decoder != options->decoder) {
+        opus_multistream_decoder_destroy(decoder);
+    }
+}
+
+OpusMSDecoder *player_decoder_reconfigure(const PlayerOptions *options, OpusMSDecoder *decoder, int sample_rate,
+                                          const OpusHeadInfo *old_head, const OpusHeadInfo *head, int *error) {
+    // Caller-owned decoders are sized for one stereo stream; ours for old_head
+    opus_int32 room = (decoder == options->decoder)
+        ? opus_multistream_decoder_get_size(1, 1)
+        : opus_multistream_decoder_get_size(old_head->streams, old_head->coupled_streams);
+    if (opus_multistream_decoder_get_size(head->streams, head->coupled_streams) > room) {
+        player_decoder_destroy(options, decoder);
+        return player_decoder_create(options, sample_rate, head, error);
+    }
+
+    *error = opus_multistream_decoder_init(decoder, sample_rate, head->channels, head->streams,
+                                           head->coupled_streams, head->mapping);
+    if (*error == OPUS_OK) {
+        return decoder;
+    }
+    player_decoder_destroy(options, decoder);
+    return NULL;
+}
+
+void player_finish(const PlayerOptions *options, AudioOutput *out, InputSource *in,
+                   int decode_errors, PlayResult *result) {
+    // A shared output keeps playing into the next track; its owner drains it
+    int shared = (out == options->shared_output);
+    if (!shared) {
+        audio_output_finish(out);
+    }
+    if (!options->quiet) {
+        if (!shared) {
+            audio_output_report(out, input_tell(in));
+        }
+
+        InputReadAheadStats readahead;
+        if (input_readahead_stats(in, &readahead) && (readahead.stalls > 0 || out->config.stats)) {
+            printf("Read-ahead: %zu KB, %llu stalls, %.1f ms waiting for input\n",
+                   readahead.depth / 1024, readahead.stalls, readahead.stall_seconds * 1000.0);
+        }
+    }
+
+    if (result) {
+        result->sample_rate = out->sample_rate;
+        result->channels = out->channels;
+        result->frames = out->frames_written;
+        result->packets = out->packets;
+        result->decode_errors = decode_errors;
+    }
+}
+
+void player_report_damage(const PlayerOptions *options, const OggDamage *damage, PlayResult *result) {
+    if (!options->quiet) {
+        if (options->ogg_crc != OGG_CRC_OFF) {
+            printf("CRC: %llu bad pages\n", damage->bad_pages);
+        }
+        if (damage->resyncs > 0) {
+            printf("Resync: %llu damaged regions, %llu bytes skipped\n",
+                   damage->resyncs, damage->skipped_bytes);
+        }
+    }
+    if (result) {
+        result->damage = *damage;
+    }
+}
+
+// Drains out and opens it again in a new format. A file cannot change
+// format half way, so it is left alone and reported instead.
+static int reopen_output(AudioOutput *out, const OutputConfig *config, int sample_rate, int channels) {
+    if (out->config.mode == OUTPUT_FILE) {
+        fprintf(stderr, "Error: Stream format (%d Hz, %d ch) differs from the output (%d Hz, %d ch)\n",
+                sample_rate, channels, out->sample_rate, out->channels);
+        return 0;
+    }
+    audio_output_finish(out);
+    audio_output_close(out);
+
+    // A stream's length says nothing about what follows it
+    OutputConfig reopened = *config;
+    reopened.length_frames = 0;
+    reopened.launch_time = 0;
+    if (!audio_output_open(out, &reopened, sample_rate, channels)) {
+        out->channels = 0;
+        return 0;
+    }
+    return 1;
+}
+
+// The mapping family only matters to an output that downmixes by it
+static int same_format(const AudioOutput *out, int sample_rate, int channels, int mapping_family) {
+    return out->channels == channels && out->sample_rate == sample_rate &&
+           (!out->downmix || out->config.mapping_family == mapping_family);
+}
+
+AudioOutput *player_open_output(const PlayerOptions *options, AudioOutput *local,
+                                const OutputConfig *config, int sample_rate, int channels) {
+    AudioOutput *shared = options->shared_output;
+    if (!shared) {
+        return audio_output_open(local, config, sample_rate, channels) ? local : NULL;
+    }
+
+    // channels is 0 until the owner's output is first opened
+    if (same_format(shared, sample_rate, channels, config->mapping_family)) {
+        return shared;
+    }
+    if (shared->channels) {
+        return reopen_output(shared, config, sample_rate, channels) ? shared : NULL;
+    }
+
+    OutputConfig shared_config = *config;
+    shared_config.length_frames = 0;
+    if (!audio_output_open(shared, &shared_config, sample_rate, channels)) {
+        shared->channels = 0;
+        return NULL;
+    }
+    return shared;
+}
+
+int player_reformat_output(AudioOutput *out, int sample_rate, int channels, int mapping_family) {
+    if (same_format(out, sample_rate, channels, mapping_family)) {
+        return 1;
+    }
+    OutputConfig config = out->config;
+    config.mapping_family = mapping_family;
+    return reopen_output(out, &config, sample_rate, channels);
+}
+
+void player_close_output(const PlayerOptions *options, AudioOutput *out) {
+    if (out != options->shared_output) {
+        audio_output_close(out);
+    }
+}
+
+void player_start_stream(OpusMSDecoder *decoder, AudioOutput *out, int gain, int pre_skip) {
+    // The float path folds the gain into its conversion; int16 lets libopus apply it
+    if (out->use_float) {
+        audio_output_set_gain(out, gain);
+    } else if (gain != 0) {
+        opus_multistream_decoder_ctl(decoder, OPUS_SET_GAIN(gain));
+    }
+
+    audio_output_skip(out, pre_skip);
+    audio_output_set_position(out, pre_skip);
+    audio_output_set_end(out, -1);
+}
+
+// data NULL decodes frame_size frames of concealment
+static int decode_into(OpusMSDecoder *decoder, AudioOutput *out, const unsigned char *data, int size,
+                       int frame_size) {
+    int num_samples;
+    double start;
+    if (out->use_float) {
+        float *pcm = audio_output_reserve_float(out);
+        start = timer_now();
+        num_samples = opus_multistream_decode_float(decoder, data, size, pcm, frame_size, 0);
+        stats_histogram_add(&out->audio_data.stats.decode_time, timer_now() - start);
+        if (num_samples > 0) audio_output_commit_float(out, num_samples);
+    } else {
+        short *pcm = audio_output_reserve(out);
+        start = timer_now();
+        num_samples = opus_multistream_decode(decoder, data, size, pcm, frame_size, 0);
+        stats_histogram_add(&out->audio_data.stats.decode_time, timer_now() - start);
+        if (num_samples > 0) audio_output_commit(out, num_samples);
+    }
+    return num_samples;
+}
+
+int player_decode(OpusMSDecoder *decoder, AudioOutput *out, const unsigned char *data, int size) {
+    return decode_into(decoder, out, data, size, FRAME_SIZE);
+}
+
+void player_conceal(OpusMSDecoder *decoder, AudioOutput *out, long long frames) {
+    const int unit = out->sample_rate / 400;
+    while (frames >= unit && !audio_output_stopped(out)) {
+        int n = (frames < FRAME_SIZE) ? (int)frames : FRAME_SIZE;
+        n -= n % unit;
+        if (decode_into(decoder, out, NULL, 0, n) <= 0) {
+            break;
+        }
+        frames -= n;
+    }
+}
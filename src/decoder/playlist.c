@@ -0,0 +1,160 @@
+#include "playlist.h"
+#include "common.h"
+#include "format_detector.h"
+#include "seek_index.h"
+
+#define PLAYLIST_MAX_PATH 4096
+
+typedef struct {
+    InputSource in;
+    int is_ogg;
+    int open;
+} PlaylistTrack;
+
+int playlist_add(Playlist *playlist, const char *path) {
+    if (playlist->count == playlist->capacity) {
+        int capacity = playlist->capacity ? playlist->capacity * 2 : 16;
+        char **paths = (char**)realloc(playlist->paths, capacity * sizeof(char*));
+        if (!paths) return 0;
+        playlist->paths = paths;
+        playlist->capacity = capacity;
+    }
+
+    playlist->paths[playlist->count] = strdup(path);
+    if (!playlist->paths[playlist->count]) return 0;
+    playlist->count++;
+    return 1;
+}
+
+int playlist_load(Playlist *playlist, const char *list_path) {
+    FILE *list = fopen(list_path, "r");
+    if (!list) {
+        fprintf(stderr, "Error: Cannot open playlist '%s'\n", list_path);
+        return 0;
+    }
+
+    char line[PLAYLIST_MAX_PATH];
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), list)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        ok = playlist_add(playlist, line);
+    }
+    fclose(list);
+    return ok;
+}
+
+void playlist_free(Playlist *playlist) {
+    for (int i = 0; i < playlist->count; i++) {
+        free(playlist->paths[i]);
+    }
+    free(playlist->paths);
+    memset(playlist, 0, sizeof(*playlist));
+}
+
+static int track_open(PlaylistTrack *track, const char *path, size_t readahead) {
+    track->open = 0;
+    if (!input_open(&track->in, path)) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", path);
+        return 0;
+    }
+    if (readahead > 0) {
+        input_start_readahead(&track->in, readahead);
+    }
+    if (!detect_format(&track->in, &track->is_ogg)) {
+        fprintf(stderr, "Error: Unable to detect format of '%s'\n", path);
+        input_close(&track->in);
+        return 0;
+    }
+    track->open = 1;
+    return 1;
+}
+
+static void track_close(PlaylistTrack *track) {
+    if (track->open) {
+        input_close(&track->in);
+        track->open = 0;
+    }
+}
+
+int playlist_play(const Playlist *playlist, const PlayerOptions *options,
+                  size_t readahead, int use_seek_index) {
+    // Opened by the first track, then reused until the format changes
+    AudioOutput out;
+    memset(&out, 0, sizeof(out));
+
+    OpusMSDecoder *decoder = (OpusMSDecoder*)malloc(opus_multistream_decoder_get_size(1, 1));
+    if (!decoder) {
+        fprintf(stderr, "Error: Failed to allocate decoder\n");
+        return 1;
+    }
+
+    PlayerOptions track_options = *options;
+    track_options.shared_output = &out;
+    track_options.decoder = decoder;
+
+    PlaylistTrack tracks[2];
+    memset(tracks, 0, sizeof(tracks));
+    track_open(&tracks[0], playlist->paths[0], readahead);
+
+    char index_path[PLAYLIST_MAX_PATH];
+    char title[PLAYLIST_MAX_PATH + 32];
+    unsigned long long input_bytes = 0;
+    int failures = 0;
+
+    for (int i = 0; i < playlist->count && !stop_playback; i++) {
+        PlaylistTrack *current = &tracks[i % 2];
+        PlaylistTrack *next = &tracks[(i + 1) % 2];
+
+        // Map and probe the next file now, so its I/O overlaps this track
+        if (i + 1 < playlist->count) {
+            track_open(next, playlist->paths[i + 1], readahead);
+        }
+
+        if (!current->open) {
+            failures++;
+            continue;
+        }
+
+        // Printed by the player once the output is open ("-o -" moves stdout)
+        snprintf(title, sizeof(title), "[%d/%d] %s", i + 1, playlist->count, playlist->paths[i]);
+        track_options.title = title;
+
+        track_options.start_seconds = (i == 0) ? options->start_seconds : 0;
+        track_options.seek_index_path = NULL;
+        if (use_seek_index && !input_is_stdin(playlist->paths[i])) {
+            snprintf(index_path, sizeof(index_path), "%s%s", playlist->paths[i], SEEK_INDEX_SUFFIX);
+            track_options.seek_index_path = index_path;
+        }
+
+        PlayResult result;
+        memset(&result, 0, sizeof(result));
+        int err = current->is_ogg ? play_ogg_opus(&current->in, &track_options, &result)
+                                  : play_custom_opus(&current->in, &track_options, &result);
+        if (err != 0 || result.decode_errors > 0) {
+            failures++;
+        }
+
+        input_bytes += input_tell(&current->in);
+        track_close(current);
+    }
+
+    track_close(&tracks[0]);
+    track_close(&tracks[1]);
+
+    // Only now does the queue drain
+    if (out.channels) {
+        audio_output_finish(&out);
+        if (!options->quiet) {
+            audio_output_report(&out, input_bytes);
+        }
+        audio_output_close(&out);
+    }
+
+    free(decoder);
+
+    if (failures > 0 && !options->quiet) {
+        fprintf(stderr, "%d of %d tracks failed\n", failures, playlist->count);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+#include "seek_index.h"
+#include "common.h"
+#include "ogg_reader.h"
+
+// Below this distance a forward walk over page headers beats bisecting
+#define SEEK_BISECT_MIN_BYTES 16384
+// Stop refining once a known point is this close to the target
+#define SEEK_CLOSE_ENOUGH (SAMPLE_RATE / 2)
+// How far past a page to look for the stream's next page
+#define SEEK_FOLLOW_MAX_BYTES (1 << 20)
+
+// Sidecar, all fields little-endian: magic, file size (u64), fingerprint
+// (u32) and point count (u32), then per point its granule (i64) and
+// offset (u64)
+#define SEEK_INDEX_MAGIC "OPSEEK2"
+#define SEEK_INDEX_HEADER_BYTES 24
+#define SEEK_INDEX_POINT_BYTES 16
+
+static void put_le32(unsigned char *p, unsigned int v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_le64(unsigned char *p, unsigned long long v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static unsigned int get_le32(const unsigned char *p) {
+    unsigned int v = 0;
+    for (int i = 0; i < 4; i++) v |= (unsigned int)p[i] << (8 * i);
+    return v;
+}
+
+static unsigned long long get_le64(const unsigned char *p) {
+    unsigned long long v = 0;
+    for (int i = 0; i < 8; i++) v |= (unsigned long long)p[i] << (8 * i);
+    return v;
+}
+
+static long long page_granule(const unsigned char *page) {
+    OggPageHeader header;
+    memcpy(&header, page, 27);
+    return (long long)header.granule_position;
+}
+
+static int page_continued(const unsigned char *page) {
+    return page[5] & 0x01;
+}
+
+static unsigned int page_serial(const unsigned char *page) {
+    OggPageHeader header;
+    memcpy(&header, page, 27);
+    return header.serial_number;
+}
+
+// First complete page at or after offset and before limit
+static int next_page(const SeekIndex *index, size_t offset, size_t limit, size_t *page_offset, size_t *page_size) {
+    while (offset + 4 <= limit) {
+        const unsigned char *hit = memchr(index->data + offset, 'O', limit - offset);
+        if (!hit) return 0;
+        offset = hit - index->data;
+        if (ogg_page_size(hit, index->size - offset, page_size) == 1) {
+            *page_offset = offset;
+            return 1;
+        }
+        offset++;
+    }
+    return 0;
+}
+
+static void seek_index_add(SeekIndex *index, SeekPoint point) {
+    int lo = 0, hi = index->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index->points[mid].offset < point.offset) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < index->count && index->points[lo].offset == point.offset) {
+        return;
+    }
+
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 64;
+        SeekPoint *points = (SeekPoint*)realloc(index->points, capacity * sizeof(SeekPoint));
+        if (!points) return;
+        index->points = points;
+        index->capacity = capacity;
+    }
+
+    memmove(&index->points[lo + 1], &index->points[lo], (index->count - lo) * sizeof(SeekPoint));
+    index->points[lo] = point;
+    index->count++;
+    index->dirty = 1;
+}
+
+// Next page of the indexed stream at or after offset
+static int next_stream_page(const SeekIndex *index, size_t offset, size_t limit, size_t *page_offset, size_t *page_size) {
+    while (next_page(index, offset, limit, page_offset, page_size)) {
+        if (page_serial(index->data + *page_offset) == index->serial) {
+            return 1;
+        }
+        offset = *page_offset + *page_size;
+    }
+    return 0;
+}
+
+// Walk pages from offset (a page start) up to limit and return the first
+// seek point found: a page with a granule followed by a page of the same
+// stream that starts a fresh packet. That page's first sample is the
+// earlier page's granule; decoding can start right after the earlier page,
+// since the reader skips other streams' pages in between.
+static int first_point_after(const SeekIndex *index, size_t offset, size_t limit, SeekPoint *point) {
+    size_t page_offset, page_size;
+    while (next_stream_page(index, offset, limit, &page_offset, &page_size)) {
+        const unsigned char *page = index->data + page_offset;
+        long long granule = page_granule(page);
+        size_t next = page_offset + page_size;
+        size_t following, following_size;
+        size_t follow_limit = (index->size - next > SEEK_FOLLOW_MAX_BYTES) ? next + SEEK_FOLLOW_MAX_BYTES : index->size;
+
+        if (granule != -1 &&
+            next_stream_page(index, next, follow_limit, &following, &following_size) &&
+            !page_continued(index->data + following)) {
+            point->granule = granule;
+            point->offset = next;
+            return 1;
+        }
+        offset = next;
+    }
+    return 0;
+}
+
+// Cheap identity check so a stale sidecar is never trusted: size plus a
+// hash of the last few KB, where the final granule lives
+static unsigned int fingerprint(const unsigned char *data, size_t size) {
+    size_t tail = (size < 4096) ? size : 4096;
+    unsigned int hash = 2166136261u;
+    for (size_t i = size - tail; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash ^ (unsigned int)size;
+}
+
+int seek_index_init(SeekIndex *index, const unsigned char *data, size_t size, size_t first_offset,
+                    unsigned int serial) {
+    memset(index, 0, sizeof(*index));
+    index->data = data;
+    index->size = size;
+    index->serial = serial;
+    index->fingerprint = fingerprint(data, size);
+
+    SeekPoint first = { 0, first_offset };
+    seek_index_add(index, first);
+    index->dirty = 0;
+    return index->count == 1;
+}
+
+void seek_index_free(SeekIndex *index) {
+    free(index->points);
+    memset(index, 0, sizeof(*index));
+}
+
+int seek_index_find(SeekIndex *index, long long granule, SeekPoint *point) {
+    if (index->count == 0) return 0;
+
+    // Known points bracketing the target
+    int lo = 0, hi = index->count;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (index->points[mid].granule <= granule) lo = mid;
+        else hi = mid;
+    }
+    SeekPoint best = index->points[lo];
+    size_t limit = (hi < index->count) ? index->points[hi].offset : index->size;
+
+    // Bisect the byte range between them
+    size_t low = best.offset;
+    size_t high = limit;
+    while (granule - best.granule > SEEK_CLOSE_ENOUGH && high - low > SEEK_BISECT_MIN_BYTES) {
+        size_t mid = low + (high - low) / 2;
+        SeekPoint probe;
+        // A page starting before high can end past it; such a point lies
+        // outside the bracket, so treat it as not found
+        if (!first_point_after(index, mid, high, &probe) || probe.offset > high) {
+            high = mid;
+            continue;
+        }
+        seek_index_add(index, probe);
+        if (probe.granule <= granule) {
+            best = probe;
+            low = probe.offset;
+        } else {
+            high = mid;
+        }
+    }
+
+    // Finish with a forward walk over the remaining page headers
+    SeekPoint probe;
+    size_t offset = best.offset;
+    while (granule - best.granule > 0 && first_point_after(index, offset, limit, &probe) &&
+           probe.granule <= granule) {
+        if (probe.offset <= best.offset) break;
+        best = probe;
+        offset = probe.offset;
+    }
+
+    seek_index_add(index, best);
+    *point = best;
+    return 1;
+}
+
+int seek_index_load(SeekIndex *index, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+
+    // The point count must match the sidecar's length exactly
+    unsigned char header[SEEK_INDEX_HEADER_BYTES];
+    long length = (fseek(f, 0, SEEK_END) == 0) ? ftell(f) : -1;
+    int ok = length >= SEEK_INDEX_HEADER_BYTES && fseek(f, 0, SEEK_SET) == 0 &&
+             fread(header, 1, sizeof(header), f) == sizeof(header) &&
+             memcmp(header, SEEK_INDEX_MAGIC, 8) == 0 &&
+             get_le64(header + 8) == index->size && get_le32(header + 16) == index->fingerprint;
+    unsigned int count = ok ? get_le32(header + 20) : 0;
+    ok = ok && count > 0 &&
+         (unsigned long long)count * SEEK_INDEX_POINT_BYTES == (unsigned long long)length - SEEK_INDEX_HEADER_BYTES;
+
+    for (unsigned int i = 0; ok && i < count; i++) {
+        unsigned char record[SEEK_INDEX_POINT_BYTES];
+        if (fread(record, 1, sizeof(record), f) != sizeof(record)) break;
+        SeekPoint point = { (long long)get_le64(record), get_le64(record + 8) };
+        // Only accept points that still land on a page boundary
+        size_t page_size;
+        if (point.offset < index->size &&
+            ogg_page_size(index->data + point.offset, index->size - point.offset, &page_size) == 1) {
+            seek_index_add(index, point);
+        }
+    }
+
+    fclose(f);
+    index->dirty = 0;
+    return ok;
+}
+
+int seek_index_save(SeekIndex *index, const char *path) {
+    if (!index->dirty) return 1;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+
+    unsigned char header[SEEK_INDEX_HEADER_BYTES];
+    memcpy(header, SEEK_INDEX_MAGIC, 8);
+    put_le64(header + 8, index->size);
+    put_le32(header + 16, index->fingerprint);
+    put_le32(header + 20, (unsigned int)index->count);
+    int ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+
+    for (int i = 0; ok && i < index->count; i++) {
+        unsigned char record[SEEK_INDEX_POINT_BYTES];
+        put_le64(record, (unsigned long long)index->points[i].granule);
+        put_le64(record + 8, index->points[i].offset);
+        ok = fwrite(record, 1, sizeof(record), f) == sizeof(record);
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) index->dirty = 0;
+    return ok;
+}
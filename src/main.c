@@ -2,47 +2,340 @@
 #include "signal_handler.h"
 #include "format_detector.h"
 #include "player.h"
+#include "input_source.h"
+#include "batch_decoder.h"
+#include "parallel_decoder.h"
+#include "seek_index.h"
+#include "custom_opus.h"
+#include "playlist.h"
+#include "mixer_server.h"
+#include "realtime.h"
+#include "audio_backend.h"
+#include "timer.h"
+#include <math.h>
 
 // Global flag definition
-volatile int stop_playback = 0;
+volatile sig_atomic_t stop_playback = 0;
+
+// Accepts seconds ("95.5") or minutes:seconds ("1:35.5")
+static double parse_time(const char *text) {
+    const char *colon = strchr(text, ':');
+    if (colon) {
+        return atof(text) * 60.0 + atof(colon + 1);
+    }
+    return atof(text);
+}
 
 void print_usage(const char *prog_name) {
     printf("opusplay - Opus Audio Player\n");
     printf("=============================\n\n");
     printf("Usage:\n");
-    printf("  %s <audio.opus>\n\n", prog_name);
+    printf("  %s [options] <audio.opus> [more.opus ...]\n", prog_name);
+    printf("  %s [options] --playlist <list.m3u>\n", prog_name);
+    printf("  %s --batch <list.txt|directory> [-j N] [--null | --output-dir DIR]\n", prog_name);
+    printf("  %s --mixer [--socket <path>]\n", prog_name);
+    printf("  %s --mixer-cmd \"<command>\" [--socket <path>]\n", prog_name);
+    printf("  An input of '-' reads standard input (a pipe, socket or redirected file)\n\n");
+    printf("Options:\n");
+    printf("  -o, --output <file>  Decode to a WAV file ('-' for stdout) instead of playing\n");
+    printf("      --raw            Write headerless 16-bit PCM instead of WAV\n");
+    printf("      --null           Decode as fast as possible and discard the audio\n");
+    printf("      --batch <src>    Decode every file in a list or directory in parallel\n");
+    printf("  -j, --jobs <n>       Worker threads: batch files, or with -o/--null split one\n");
+    printf("                       Ogg file into chunks decoded in parallel\n");
+    printf("      --output-dir <d> Batch: write <name>.wav (or .raw) files into <d>\n");
+    printf("      --playlist <f>   Play the files listed in <f> (one per line) gaplessly\n");
+    printf("      --start <time>   Start at seconds or mm:ss\n");
+    printf("      --buffer <ms>    Playback queue depth (default %d ms)\n", DEFAULT_BUFFER_MS);
+    printf("      --frames <n|auto> Frames per device buffer (default %d)\n", DEFAULT_FRAMES_PER_BUFFER);
+    printf("      --latency <ms>   Suggested device latency (default: device low latency)\n");
+    printf("      --device-rate <hz> Run the device at this rate (default: its own rate);\n");
+    printf("                       decodes at it when Opus can, else resamples\n");
+    printf("      --device-channels <n> Fold surround down to at most n channels\n");
+    printf("                       (default: as many as the device takes)\n");
+    printf("      --low-latency    Live monitoring preset: %d ms queue, %d-frame buffers\n",
+           LOW_LATENCY_BUFFER_MS, LOW_LATENCY_FRAMES_PER_BUFFER);
+    printf("      --realtime       Raise the decode thread's priority and lock its buffers\n");
+    printf("                       in memory, as far as the system permits\n");
+    printf("      --cpu <n>        Pin the decode thread to CPU n (implies --realtime)\n");
+    printf("      --readahead <KB> Input read-ahead depth on a background thread\n");
+    printf("                       (default %d KB, 0 to read on the decode thread)\n", INPUT_READAHEAD_DEFAULT / 1024);
+    printf("      --volume <pct>   Software volume in percent (uses the float path)\n");
+    printf("      --float          Decode to float and convert with the SIMD kernel\n");
+    printf("      --dither         Add TPDF dither when converting to 16-bit\n");
+    printf("      --stats          Print underruns and callback/decode timing after playback\n");
+    printf("      --stats-json <f> Append a JSON stats line every interval ('-' for stderr)\n");
+    printf("      --stats-interval <s> Seconds between JSON stats lines (default 1)\n");
+    printf("      --verify-crc     Check Ogg page checksums; skip and count bad pages\n");
+    printf("      --strict         Check Ogg page checksums; stop at the first bad page\n");
+    printf("      --seek-index     Keep the seek index in <audio.opus>%s\n", SEEK_INDEX_SUFFIX);
+    printf("      --write-index <f> Rewrite a custom raw Opus file as version %d with\n", CUSTOM_OPUS_VERSION_INDEXED);
+    printf("                       a length header and seek table\n");
+    printf("      --simulate <spec> Play into a virtual device on a simulated clock, faster\n");
+    printf("                       than realtime: decode=<ms>, decode-jitter=<ms>,\n");
+    printf("                       stall=<ms>/<sec>, jitter=<ms>, seed=<n>, trace=<csv>\n");
+    printf("      --mixer          Mix files sent over a control socket into one stream\n");
+    printf("      --mixer-cmd <c>  Send a command to a running mixer: play [-g dB] <file>,\n");
+    printf("                       stop <id>, gain <id> <dB>, list or quit\n");
+    printf("      --socket <path>  Mixer control socket (default %s)\n\n", mixer_default_socket());
     printf("Examples:\n");
     printf("  %s music.opus\n", prog_name);
-    printf("  %s recording.opus\n\n", prog_name);
+    printf("  %s recording.opus\n", prog_name);
+    printf("  %s --start 2:30 music.opus\n", prog_name);
+    printf("  %s side_a.opus side_b.opus\n", prog_name);
+    printf("  %s -o music.wav music.opus\n", prog_name);
+    printf("  opusenc input.wav - | %s -\n", prog_name);
+    printf("  %s --null music.opus\n", prog_name);
+    printf("  %s -j 8 -o long.wav long_recording.opus\n", prog_name);
+    printf("  %s --batch archive/ -j 8\n", prog_name);
+    printf("  %s --batch archive/ --null --verify-crc\n", prog_name);
+    printf("  %s --simulate decode=2,stall=80/5,trace=fill.csv --buffer 100 --stats music.opus\n", prog_name);
+    printf("  %s --mixer & %s --mixer-cmd \"play -g -6 music.opus\"\n\n", prog_name, prog_name);
     printf("Supported formats:\n");
     printf("  ✓ Ogg Opus (universal format)\n");
     printf("  ✓ Custom Raw Opus (from eopus)\n\n");
     printf("Controls:\n");
-    printf("  Ctrl+C : Stop playback\n");
+    printf("  Left/Right (or ,/.) : Seek -/+%d sec\n", SEEK_STEP_SECONDS);
+    printf("  Ctrl+C              : Stop playback\n");
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        print_usage(argv[0]);
+static int play_file(const char *filename, PlayerOptions *options, int jobs, size_t readahead,
+                     int use_seek_index, const char *index_output) {
+    // Open input once; the detector and the player share it
+    InputSource in;
+    if (!input_open(&in, filename)) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
         return 1;
     }
 
-    const char *filename = argv[1];
-
-    // Setup signal handler
-    signal(SIGINT, signal_handler);
+    // Slow disks and network mounts stall the reader thread, not the decoder
+    if (readahead > 0) {
+        input_start_readahead(&in, readahead);
+    }
 
     // Detect format
     int is_ogg;
-    if (!detect_format(filename, &is_ogg)) {
+    if (!detect_format(&in, &is_ogg)) {
         fprintf(stderr, "Error: Unable to detect file format or file not found\n");
+        input_close(&in);
         return 1;
     }
 
+    if (index_output) {
+        CustomOpusInfo info;
+        int ok = 0;
+        if (is_ogg) {
+            fprintf(stderr, "Error: --write-index applies to custom raw Opus files\n");
+        } else if (custom_opus_read_header(&in, &info)) {
+            ok = custom_opus_write_indexed(&in, &info, index_output);
+        }
+        input_close(&in);
+        return ok ? 0 : 1;
+    }
+
+    char index_path[4096];
+    if (use_seek_index && !input_is_stdin(filename)) {
+        snprintf(index_path, sizeof(index_path), "%s%s", filename, SEEK_INDEX_SUFFIX);
+        options->seek_index_path = index_path;
+    }
+
     // Play based on format
-    if (is_ogg) {
-        return play_ogg_opus(filename);
+    int result;
+    if (is_ogg && jobs > 1 && options->output.mode != OUTPUT_DEVICE && options->start_seconds <= 0) {
+        result = decode_ogg_parallel(&in, options, jobs, NULL);
+    } else if (is_ogg) {
+        result = play_ogg_opus(&in, options, NULL);
+    } else {
+        result = play_custom_opus(&in, options, NULL);
+    }
+
+    input_close(&in);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    PlayerOptions options;
+    memset(&options, 0, sizeof(options));
+    options.output.mode = OUTPUT_DEVICE;
+    options.output.launch_time = timer_now();
+
+    BatchOptions batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.mode = OUTPUT_NULL;
+
+    Playlist playlist;
+    memset(&playlist, 0, sizeof(playlist));
+    const char *playlist_path = NULL;
+    int use_seek_index = 0;
+    const char *index_output = NULL;
+    int low_latency = 0;
+    int realtime = 0;
+    int cpu = -1;
+    long readahead_kb = INPUT_READAHEAD_DEFAULT / 1024;
+    int mixer = 0;
+    const char *mixer_command = NULL;
+    const char *socket_path = NULL;
+    static SimConfig simulate;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
+            options.output.mode = OUTPUT_FILE;
+            options.output.path = argv[++i];
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            options.output.raw = 1;
+        } else if (strcmp(argv[i], "--null") == 0) {
+            options.output.mode = OUTPUT_NULL;
+            batch.mode = OUTPUT_NULL;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch.source = argv[++i];
+        } else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+            batch.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output-dir") == 0 && i + 1 < argc) {
+            batch.mode = OUTPUT_FILE;
+            batch.output_dir = argv[++i];
+        } else if (strcmp(argv[i], "--buffer") == 0 && i + 1 < argc) {
+            options.output.buffer_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            i++;
+            options.output.frames_per_buffer = (strcmp(argv[i], "auto") == 0) ? -1 : atoi(argv[i]);
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            options.output.latency_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--device-rate") == 0 && i + 1 < argc) {
+            options.output.device_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--device-channels") == 0 && i + 1 < argc) {
+            options.output.device_channels = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            low_latency = 1;
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime = 1;
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            realtime = 1;
+            cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--readahead") == 0 && i + 1 < argc) {
+            readahead_kb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--volume") == 0 && i + 1 < argc) {
+            double percent = atof(argv[++i]);
+            options.output.volume_db = (percent > 0) ? 20.0 * log10(percent / 100.0) : -200.0;
+        } else if (strcmp(argv[i], "--float") == 0) {
+            options.output.float_pcm = 1;
+        } else if (strcmp(argv[i], "--dither") == 0) {
+            options.output.dither = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.output.stats = 1;
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            options.output.stats_json = argv[++i];
+        } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            options.output.stats_interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--playlist") == 0 && i + 1 < argc) {
+            playlist_path = argv[++i];
+        } else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
+            options.start_seconds = parse_time(argv[++i]);
+        } else if (strcmp(argv[i], "--verify-crc") == 0) {
+            if (options.ogg_crc == OGG_CRC_OFF) options.ogg_crc = OGG_CRC_CHECK;
+        } else if (strcmp(argv[i], "--strict") == 0) {
+            options.ogg_crc = OGG_CRC_STRICT;
+        } else if (strcmp(argv[i], "--seek-index") == 0) {
+            use_seek_index = 1;
+        } else if (strcmp(argv[i], "--write-index") == 0 && i + 1 < argc) {
+            index_output = argv[++i];
+        } else if (strcmp(argv[i], "--simulate") == 0 && i + 1 < argc) {
+            if (!sim_config_parse(&simulate, argv[++i])) {
+                playlist_free(&playlist);
+                return 1;
+            }
+            options.output.simulate = &simulate;
+        } else if (strcmp(argv[i], "--mixer") == 0) {
+            mixer = 1;
+        } else if (strcmp(argv[i], "--mixer-cmd") == 0 && i + 1 < argc) {
+            mixer_command = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "Error: Unknown option '%s'\n\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        } else if (!playlist_add(&playlist, argv[i])) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+    }
+
+    if (playlist_path && !playlist_load(&playlist, playlist_path)) {
+        playlist_free(&playlist);
+        return 1;
+    }
+
+    // The preset only fills in what was not given explicitly
+    if (low_latency) {
+        if (!options.output.buffer_ms) options.output.buffer_ms = LOW_LATENCY_BUFFER_MS;
+        if (!options.output.frames_per_buffer) options.output.frames_per_buffer = LOW_LATENCY_FRAMES_PER_BUFFER;
+    }
+
+    // Setup signal handler
+    signal_handler_install();
+
+    if (!socket_path) {
+        socket_path = mixer_default_socket();
+    }
+    if (mixer_command) {
+        playlist_free(&playlist);
+        return mixer_send(socket_path, mixer_command);
+    }
+
+    // Before the first file is mapped, so the lock covers code, libraries
+    // and heap but not whole input files
+    if (realtime) {
+        options.output.realtime = 1;
+        realtime_enter(cpu);
+        realtime_report();
+    }
+    if (mixer) {
+        // The server thread only polls its socket; each track raises its own
+        realtime_suspend();
+        playlist_free(&playlist);
+        int result = mixer_serve(&options, socket_path);
+        audio_backend_shutdown();
+        return result;
+    }
+
+    if (batch.source) {
+        batch.raw = options.output.raw;
+        batch.ogg_crc = options.ogg_crc;
+        playlist_free(&playlist);
+        return batch_decode(&batch);
+    }
+
+    if (playlist.count == 0) {
+        print_usage(argv[0]);
+        playlist_free(&playlist);
+        return 1;
+    }
+
+    size_t readahead = (readahead_kb > 0) ? (size_t)readahead_kb * 1024 : 0;
+
+    // A simulation never touches the audio backend, so it runs headless
+    if (options.output.simulate && options.output.mode == OUTPUT_DEVICE && !options.output.device_rate) {
+        options.output.device_rate = SIM_DEFAULT_RATE;
+    }
+
+    // Device start-up overlaps opening and parsing the first file
+    if (options.output.mode == OUTPUT_DEVICE && !options.output.simulate && !index_output) {
+        audio_backend_preload();
+    }
+
+    // Several tracks share one output stream so they join without gaps
+    int result = 1;
+    if (playlist.count > 1 || playlist_path) {
+        if (index_output) {
+            fprintf(stderr, "Error: --write-index takes a single file\n");
+        } else {
+            result = playlist_play(&playlist, &options, readahead, use_seek_index);
+        }
     } else {
-        return play_custom_opus(filename);
+        result = play_file(playlist.paths[0], &options, batch.jobs, readahead, use_seek_index, index_output);
     }
+
+    audio_backend_shutdown();
+    playlist_free(&playlist);
+    return result;
 }